@@ -25,6 +25,8 @@
 #define __DEF_KIWI_DSP__
 
 #include "KiwiDspDevice.h"
+#include "KiwiDspStatic.h"
+#include "KiwiDspVoice.h"
 
 #endif
 
@@ -0,0 +1,147 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#include "KiwiDspArena.h"
+
+#ifdef __KIWI_DSP_HUGEPAGES__
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+#endif
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP ARENA                                   //
+    // ================================================================================ //
+    
+    DspArena::DspArena() noexcept :
+    m_offset(0ul),
+    m_size(0ul)
+    {
+        ;
+    }
+    
+    DspArena::~DspArena() noexcept
+    {
+        release();
+    }
+    
+    char* DspArena::create(const ulong size) noexcept
+    {
+        void* slab = nullptr;
+#if defined(_WIN32)
+        slab = _aligned_malloc(size, alignment);
+#elif defined(__KIWI_DSP_HUGEPAGES__) && defined(__linux__)
+        const ulong hugesize = 2097152ul;
+        if(size >= hugesize)
+        {
+            if(posix_memalign(&slab, hugesize, (size + hugesize - 1ul) & ~(hugesize - 1ul)))
+            {
+                slab = nullptr;
+            }
+            else
+            {
+                madvise(slab, (size + hugesize - 1ul) & ~(hugesize - 1ul), MADV_HUGEPAGE);
+            }
+        }
+        else if(posix_memalign(&slab, alignment, size))
+        {
+            slab = nullptr;
+        }
+#else
+        if(posix_memalign(&slab, alignment, size))
+        {
+            slab = nullptr;
+        }
+#endif
+        return (char *)slab;
+    }
+    
+    void DspArena::destroy(char* slab, const ulong) noexcept
+    {
+#if defined(_WIN32)
+        _aligned_free(slab);
+#else
+        free(slab);
+#endif
+    }
+    
+    bool DspArena::reserve(const ulong size) noexcept
+    {
+        release();
+        if(size)
+        {
+            char* slab = create(align(size));
+            if(slab)
+            {
+                m_slabs.push_back(make_pair(slab, align(size)));
+                return true;
+            }
+            return false;
+        }
+        return true;
+    }
+    
+    void* DspArena::allocate(const ulong size) noexcept
+    {
+        const ulong asize = align(size ? size : 1ul);
+        if(m_slabs.empty() || m_offset + asize > m_slabs.back().second)
+        {
+            const ulong ssize = max(asize, (ulong)65536ul);
+            char* slab = create(ssize);
+            if(!slab)
+            {
+                return nullptr;
+            }
+            m_slabs.push_back(make_pair(slab, ssize));
+            m_offset = 0ul;
+        }
+        void* mem = m_slabs.back().first + m_offset;
+        m_offset += asize;
+        m_size   += asize;
+        return mem;
+    }
+    
+    void DspArena::release() noexcept
+    {
+        for(vector<pair<char*, ulong>>::size_type i = 0; i < m_slabs.size(); i++)
+        {
+            destroy(m_slabs[i].first, m_slabs[i].second);
+        }
+        m_slabs.clear();
+        m_offset = 0ul;
+        m_size   = 0ul;
+    }
+    
+    void DspArena::swap(DspArena& other) noexcept
+    {
+        m_slabs.swap(other.m_slabs);
+        std::swap(m_offset, other.m_offset);
+        std::swap(m_size, other.m_size);
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_ARENA__
+#define __DEF_KIWI_DSP_ARENA__
+
+#include "KiwiDspError.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP ARENA                                   //
+    // ================================================================================ //
+
+    //! The dsp arena owns the memory of the signals of a compiled chain.
+    /**
+     The dsp arena allocates one aligned slab when the chain is compiled and carves the signals and the scratch memory of the nodes from it. All the memory is released at once when the chain stops. If the slab is full, the arena appends a new slab so the memory that was already given stays valid. If the __KIWI_DSP_HUGEPAGES__ flag is defined, the slabs are backed by huge pages when the system allows it.
+     */
+    class DspArena
+    {
+    public:
+        static const ulong alignment = 64ul;
+    private:
+        vector<pair<char*, ulong>>  m_slabs;
+        ulong                       m_offset;
+        ulong                       m_size;
+
+        static char* create(const ulong size) noexcept;
+        static void  destroy(char* slab, const ulong size) noexcept;
+    public:
+
+        //! Constructor.
+        /** The function initializes an empty arena.
+         */
+        DspArena() noexcept;
+
+        //! Destructor.
+        /** The function frees all the slabs.
+         */
+        ~DspArena() noexcept;
+
+        //! Round a size to the alignment of the arena.
+        /** The function rounds a size in bytes to the alignment of the arena.
+         @param size The size in bytes.
+         @return The aligned size in bytes.
+         */
+        static inline ulong align(const ulong size) noexcept
+        {
+            return (size + alignment - 1ul) & ~(alignment - 1ul);
+        }
+
+        //! Allocate the main slab.
+        /** The function releases the memory and allocates a new slab of a given size.
+         @param size The size of the slab in bytes.
+         @return true if the slab has been allocated, otherwise false.
+         */
+        bool reserve(const ulong size) noexcept;
+
+        //! Allocate memory from the arena.
+        /** The function carves an aligned block from the arena, a new slab is allocated if the current one is full.
+         @param size The size in bytes.
+         @return The memory or nullptr if the allocation failed.
+         */
+        void* allocate(const ulong size) noexcept;
+
+        //! Allocate a vector of samples from the arena.
+        /** The function carves a cleared vector of samples from the arena.
+         @param size The number of samples.
+         @return The vector or nullptr if the allocation failed.
+         */
+        inline sample* allocateSamples(const ulong size) noexcept
+        {
+            sample* vec = (sample *)allocate(size * sizeof(sample));
+            if(vec)
+            {
+                Signal::vclear(size, vec);
+            }
+            return vec;
+        }
+
+        //! Release all the memory.
+        /** The function frees all the slabs at once.
+         */
+        void release() noexcept;
+
+        //! Exchange the memory with another arena.
+        /** The function swaps the slabs of two arenas, the memory given by each arena stays valid.
+         @param other The other arena.
+         */
+        void swap(DspArena& other) noexcept;
+
+        //! Retrieve the number of bytes used.
+        /** The function retrieves the number of bytes carved from the arena.
+         @return The number of bytes.
+         */
+        inline ulong getSize() const noexcept
+        {
+            return m_size;
+        }
+
+        //! Retrieve the number of slabs.
+        /** The function retrieves the number of slabs allocated by the arena.
+         @return The number of slabs.
+         */
+        inline ulong getNumberOfSlabs() const noexcept
+        {
+            return (ulong)m_slabs.size();
+        }
+    };
+}
+
+
+#endif
+
+
@@ -23,16 +23,377 @@
 
 #include "KiwiDspChain.h"
 #include "KiwiDspContext.h"
+#include <typeinfo>
 
 namespace Kiwi
 {
     // ================================================================================ //
-    //                                      DSP CONTEXT                                 //
+    //                                      DSP PLAN                                    //
+    // ================================================================================ //
+    
+    DspPlan::DspPlan(vector<sDspNode> const& nodes, DspIndex const& index, set<sDspNode> const& excluded, const ulong vectorsize, const ulong nticks, shared_ptr<DspPool> pool, const bool profile, const bool staged) :
+    m_nnodes(0ul),
+    m_vectorsize(vectorsize),
+    m_nticks(nticks),
+    m_pool(pool),
+    m_parallel(false),
+    m_nfused(0ul),
+    m_remaining(0l),
+    m_stage(staged ? pending : installed)
+    {
+        unordered_map<DspNode*, ulong> tasks;
+        vector<DspNode*> included;
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+        {
+            DspNode* node = nodes[i].get();
+            if(staged)
+            {
+                m_staged.push_back(node);
+            }
+            const bool running = staged ? (node->index && !node->m_dead) : node->isRunning();
+            if(running && !node->m_constant && excluded.find(nodes[i]) == excluded.end())
+            {
+                tasks[node] = (ulong)included.size();
+                included.push_back(node);
+            }
+        }
+        
+        // A node is fused with its reader if both are elementwise and the reader is the only node that reads it.
+        const ulong none = ~0ul;
+        vector<ulong> previous(included.size(), none), next(included.size(), none), chained(included.size(), none);
+        for(vector<DspNode*>::size_type i = 0; i < included.size(); i++)
+        {
+            DspNode* node = included[i];
+            const DspIndex::Range readers = index.getReaders(node, 0ul);
+            if(!staged && isFusable(node) && readers.size() == 1ul)
+            {
+                DspNode* reader = readers.begin()->node;
+                const ulong input = readers.begin()->port;
+                auto it = tasks.find(reader);
+                if(it != tasks.end() && isFusable(reader) && index.getSources(reader, input).size() == 1ul)
+                {
+                    next[i] = it->second;
+                    previous[it->second] = i;
+                    chained[it->second] = input;
+                }
+            }
+        }
+        
+        for(vector<DspNode*>::size_type i = 0; i < included.size(); i++)
+        {
+            DspNode* node = included[i];
+            m_tasks.push_back({(ulong)m_operations.size(), 0ul, 0ul});
+            for(ulong j = 0; j < node->m_nins; j++)
+            {
+                DspInput* input = node->getCompiledInput(j);
+                if((input->m_nothers || input->m_ntaps || input->m_nfollows) && !(previous[i] != none && j == chained[i]))
+                {
+                    m_operations.push_back({merge, input});
+                }
+            }
+            for(ulong j = 0; j < node->m_nouts; j++)
+            {
+                if(node->getCompiledOutput(j)->isSwapped())
+                {
+                    m_operations.push_back({swap, node->getCompiledOutput(j)});
+                }
+            }
+            
+            if(previous[i] != none || next[i] != none)
+            {
+                // The run is performed by the last node, once all the inputs of the run have been merged.
+                if(next[i] == none)
+                {
+                    vector<ulong> run(1, i);
+                    while(previous[run.back()] != none)
+                    {
+                        run.push_back(previous[run.back()]);
+                    }
+                    reverse(run.begin(), run.end());
+                    
+                    Fusion* fusion = new Fusion();
+                    ulong result = 0ul;
+                    for(vector<ulong>::size_type k = 0; k < run.size(); k++)
+                    {
+                        DspNode* member = included[run[k]];
+                        vector<ulong> registers(member->m_nins, 0ul);
+                        for(ulong j = 0; j < member->m_nins; j++)
+                        {
+                            if(k && j == chained[run[k]])
+                            {
+                                registers[j] = result;
+                            }
+                            else
+                            {
+                                registers[j] = fusion->kernel.input((ulong)fusion->inputs.size());
+                                fusion->inputs.push_back(member->m_sample_ins[j]);
+                            }
+                        }
+                        result = fusion->kernel.append(*member->m_kernel, registers);
+                    }
+                    fusion->kernel.setResult(result);
+                    fusion->output  = node->m_sample_outs[0];
+                    fusion->signal  = node->m_outputs[0].get();
+                    fusion->size    = vectorsize;
+                    m_fusions.push_back(unique_ptr<Fusion>(fusion));
+                    m_operations.push_back({fuse, fusion});
+                    m_nfused += (ulong)run.size();
+                }
+            }
+            // The nodes of a staged plan are prepared at its first tick, they can decide not to perform.
+            else if(staged)
+            {
+                m_operations.push_back({launch, node});
+            }
+            // The nodes that don't bypass the silence and don't receive events only need the perform method.
+            else if(node->m_bypass || node->m_queue)
+            {
+                m_operations.push_back({tick, node});
+            }
+            else
+            {
+                m_operations.push_back({perform, node});
+            }
+            m_tasks.back().end = (ulong)m_operations.size();
+            m_nnodes++;
+        }
+        
+        // The profiled plan replaces the operations of each node by a probe that times them, the other plan isn't slowed down.
+        if(profile)
+        {
+            m_probed.swap(m_operations);
+            m_probes.reserve(m_nnodes);
+            for(ulong i = 0; i < m_nnodes; i++)
+            {
+                const ulong begin = m_tasks[i].begin, end = m_tasks[i].end;
+                m_tasks[i].begin = (ulong)m_operations.size();
+                if(end > begin)
+                {
+                    m_probes.push_back({m_probed.data() + begin, m_probed.data() + end, included[i]});
+                    m_operations.push_back({probe, &m_probes.back()});
+                }
+                m_tasks[i].end = (ulong)m_operations.size();
+            }
+        }
+        
+        if(m_pool && m_nnodes >= 2ul * (m_pool->getNumberOfThreads() + 1ul))
+        {
+            // A link orders the tasks of its nodes as in the serial plan, a feedback link too because the reader uses the vector of the source of the previous block.
+            vector<pair<ulong, ulong>> edges;
+            for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+            {
+                auto to = tasks.find(nodes[i].get());
+                if(to != tasks.end())
+                {
+                    for(ulong j = 0; j < nodes[i]->m_nins; j++)
+                    {
+                        const DspIndex::Range sources = index.getSources(nodes[i].get(), j);
+                        for(auto it = sources.begin(); it != sources.end(); ++it)
+                        {
+                            auto from = tasks.find(it->node);
+                            if(from != tasks.end() && from->second != to->second)
+                            {
+                                edges.push_back(make_pair(min(from->second, to->second), max(from->second, to->second)));
+                            }
+                        }
+                    }
+                }
+            }
+            sort(edges.begin(), edges.end());
+            edges.erase(unique(edges.begin(), edges.end()), edges.end());
+            
+            bool branches = false;
+            m_offsets.assign(m_nnodes + 1ul, 0ul);
+            for(vector<pair<ulong, ulong>>::size_type i = 0; i < edges.size(); i++)
+            {
+                m_offsets[edges[i].first + 1ul]++;
+                m_tasks[edges[i].second].npredecessors++;
+            }
+            for(ulong i = 0; i < m_nnodes; i++)
+            {
+                branches = branches || m_offsets[i + 1ul] > 1ul;
+                m_offsets[i + 1ul] += m_offsets[i];
+                if(!m_tasks[i].npredecessors)
+                {
+                    m_roots.push_back(i);
+                }
+            }
+            for(vector<pair<ulong, ulong>>::size_type i = 0; i < edges.size(); i++)
+            {
+                m_successors.push_back(edges[i].second);
+            }
+            
+            // A chain of nodes without branches is performed serially.
+            if(branches || m_roots.size() > 1ul)
+            {
+                m_parallel = true;
+                m_counters = unique_ptr<atomic<ulong>[]>(new atomic<ulong>[m_nnodes]);
+                for(ulong i = 0; i <= m_pool->getNumberOfThreads(); i++)
+                {
+                    m_queues.push_back(unique_ptr<DspTaskQueue>(new DspTaskQueue(m_nnodes)));
+                }
+            }
+        }
+    }
+    
+    DspPlan::~DspPlan()
+    {
+        // The workers that are late can still be leaving the plan.
+        if(m_parallel)
+        {
+            m_pool->synchronize();
+        }
+    }
+    
+    void DspPlan::prepare() const noexcept
+    {
+        for(ulong i = 0; i < m_nnodes; i++)
+        {
+            m_counters[i].store(m_tasks[i].npredecessors, memory_order_relaxed);
+        }
+        for(vector<ulong>::size_type i = 0; i < m_roots.size(); i++)
+        {
+            m_queues[0]->push(m_roots[i]);
+        }
+        m_remaining.store((long)m_nnodes, memory_order_release);
+    }
+    
+    void DspPlan::work(const ulong index) const noexcept
+    {
+        DspTaskQueue& queue = *m_queues[index];
+        const ulong nqueues = (ulong)m_queues.size();
+        while(m_remaining.load(memory_order_acquire) > 0l)
+        {
+            ulong task = queue.pop();
+            for(ulong i = 1; task == DspTaskQueue::empty && i < nqueues; i++)
+            {
+                task = m_queues[(index + i) % nqueues]->steal();
+            }
+            if(task != DspTaskQueue::empty)
+            {
+                for(ulong i = m_tasks[task].begin; i < m_tasks[task].end; i++)
+                {
+                    m_operations[i].method(m_operations[i].target);
+                }
+                for(ulong i = m_offsets[task]; i < m_offsets[task + 1ul]; i++)
+                {
+                    if(m_counters[m_successors[i]].fetch_sub(1ul, memory_order_acq_rel) == 1ul)
+                    {
+                        queue.push(m_successors[i]);
+                    }
+                }
+                m_remaining.fetch_sub(1l, memory_order_release);
+            }
+        }
+    }
+    
+    bool DspPlan::isFusable(DspNode const* node) noexcept
+    {
+        if(!node->m_kernel || node->m_bypass || node->m_queue || node->m_nouts != 1ul || node->m_kernel->getNumberOfInputs() > node->m_nins)
+        {
+            return false;
+        }
+        if(node->m_outputs[0]->getNumberOfChannels() != 1ul || node->m_outputs[0]->m_nfeedbacks)
+        {
+            return false;
+        }
+        for(ulong i = 0; i < node->m_nins; i++)
+        {
+            if(node->m_inputs[i]->getNumberOfChannels() != 1ul || node->m_inputs[i]->m_nfeedbacks || node->m_inputs[i]->m_nfollows)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    void DspPlan::fuse(void* fusion) noexcept
+    {
+        Fusion* f = (Fusion *)fusion;
+        f->kernel.perform(f->size, f->inputs.data(), f->output);
+        f->signal->update();
+    }
+    
+    void DspPlan::merge(void* input) noexcept
+    {
+        ((DspInput *)input)->perform();
+    }
+    
+    void DspPlan::swap(void* output) noexcept
+    {
+        ((DspOutput *)output)->swap();
+    }
+    
+    void DspPlan::probe(void* probe) noexcept
+    {
+        const Probe* p = (const Probe *)probe;
+        const ulong start = DspLoad::cycles();
+        for(const Operation* op = p->begin; op != p->end; ++op)
+        {
+            op->method(op->target);
+        }
+        const ulong cycles = DspLoad::cycles() - start;
+        DspNode* node = p->node;
+        node->m_ncalls.store(node->m_ncalls.load(memory_order_relaxed) + 1ul, memory_order_relaxed);
+        node->m_cycles.store(node->m_cycles.load(memory_order_relaxed) + cycles, memory_order_relaxed);
+        if(cycles < node->m_mincycles.load(memory_order_relaxed))
+        {
+            node->m_mincycles.store(cycles, memory_order_relaxed);
+        }
+        if(cycles > node->m_maxcycles.load(memory_order_relaxed))
+        {
+            node->m_maxcycles.store(cycles, memory_order_relaxed);
+        }
+    }
+    
+    void DspPlan::tick(void* node) noexcept
+    {
+        ((DspNode *)node)->tick();
+    }
+    
+    void DspPlan::perform(void* node) noexcept
+    {
+        DspNode* n = (DspNode *)node;
+        n->perform();
+        for(ulong i = 0; i < n->m_nouts; i++)
+        {
+            n->m_outputs[i]->update();
+        }
+    }
+    
+    void DspPlan::launch(void* node) noexcept
+    {
+        DspNode* n = (DspNode *)node;
+        if(n->m_running)
+        {
+            n->tick();
+        }
+    }
+    
+    // ================================================================================ //
+    //                                      DSP CHAIN                                   //
     // ================================================================================ //
     
     DspChain::DspChain(sDspContext context) noexcept :
     m_context(context),
-    m_running(false)
+    m_running(false),
+    m_blocksize(0ul),
+    m_samplerate(0ul),
+    m_vectorsize(0ul),
+    m_nticks(1ul),
+    m_offset(0ul),
+    m_compiled(0ul),
+    m_time(0ul),
+    m_ndeads(0ul),
+    m_nconstants(0ul),
+    m_recompile(false),
+    m_nfused(0ul),
+    m_latency(0ul),
+    m_profiling(false),
+    m_ntransactions(0ul),
+    m_suspended(false),
+    m_nhits(0ul),
+    m_nmisses(0ul)
     {
         
     }
@@ -43,9 +404,12 @@ namespace Kiwi
         {
             stop();
         }
+        publish(nullptr);
         lock_guard<mutex> guard(m_mutex);
         m_nodes.clear();
         m_links.clear();
+        m_nodeset.clear();
+        m_linkset.clear();
     }
     
     sDspDeviceManager DspChain::getDeviceManager() const noexcept
@@ -79,7 +443,12 @@ namespace Kiwi
         sDspContext context = getContext();
         if(context)
         {
-            return context->getVectorSize();
+            const ulong vectorsize = context->getVectorSize();
+            if(m_blocksize && m_blocksize < vectorsize && !(vectorsize % m_blocksize))
+            {
+                return m_blocksize;
+            }
+            return vectorsize;
         }
         else
         {
@@ -87,21 +456,19 @@ namespace Kiwi
         }
     }
     
-    void DspChain::add(sDspNode node) throw(DspError&)
+    void DspChain::setBlockSize(const ulong blocksize) throw(DspError&)
     {
-        if(node)
+        bool deferred = false;
+        {
+            lock_guard<mutex> guard(m_mutex);
+            m_blocksize = blocksize;
+            deferred = m_ntransactions > 0ul;
+        }
+        if(m_running && !deferred)
         {
-            const bool state = suspend();
-            {
-                lock_guard<mutex> guard(m_mutex);
-                if(find(m_nodes.begin(), m_nodes.end(), node) == m_nodes.end())
-                {
-                    m_nodes.push_back(node);
-                }
-            }
             try
             {
-                resume(state);
+                start();
             }
             catch(DspError& e)
             {
@@ -110,21 +477,22 @@ namespace Kiwi
         }
     }
     
-    void DspChain::add(sDspLink link)  throw(DspError&)
+    void DspChain::setNumberOfThreads(const ulong nthreads, vector<ulong> const& cores) throw(DspError&)
     {
-        if(link && link->isValid())
+        // The plans that use the previous pool keep it alive until they are replaced.
+        shared_ptr<DspPool> pool(nthreads ? new DspPool(nthreads, cores) : nullptr);
+        bool deferred = false;
+        {
+            lock_guard<mutex> guard(m_mutex);
+            m_pool.swap(pool);
+            deferred = m_ntransactions > 0ul;
+        }
+        pool.reset();
+        if(m_running && !deferred)
         {
-            const bool state = suspend();
-            {
-                lock_guard<mutex> guard(m_mutex);
-                if(find(m_links.begin(), m_links.end(), link) == m_links.end())
-                {
-                    m_links.push_back(link);
-                }
-            }
             try
             {
-                resume(state);
+                start();
             }
             catch(DspError& e)
             {
@@ -133,143 +501,1145 @@ namespace Kiwi
         }
     }
     
-    void DspChain::remove(sDspNode node) throw(DspError&)
+    void DspChain::setProfiling(const bool status)
     {
-        if(node)
+        lock_guard<mutex> guard(m_mutex);
+        if(status != m_profiling)
         {
-            const bool state = suspend();
-            {
-                lock_guard<mutex> guard(m_mutex);
-                auto it = find(m_nodes.begin(), m_nodes.end(), node);
-                if(it != m_nodes.end())
-                {
-                    m_nodes.erase(it);
-                }
-            }
-            try
+            m_profiling = status;
+            for(vector<sDspNode>::size_type i = 0; i < m_nodes.size() && status; i++)
             {
-                resume(state);
+                m_nodes[i]->clearProfile();
             }
-            catch(DspError& e)
+            if(m_running)
             {
-                throw e;
+                publish(set<sDspNode>());
             }
         }
     }
     
-    void DspChain::remove(sDspLink link)  throw(DspError&)
+    vector<sDspNode> DspChain::getProfile() const
     {
-        if(link)
+        lock_guard<mutex> guard(m_mutex);
+        vector<sDspNode> nodes(m_nodes);
+        stable_sort(nodes.begin(), nodes.end(), [](sDspNode const& node1, sDspNode const& node2)
+        {
+            return node1->getCycles() > node2->getCycles();
+        });
+        return nodes;
+    }
+    
+    void DspChain::add(sDspNode node) throw(DspError&)
+    {
+        if(node)
         {
-            const bool state = suspend();
+            lock_guard<mutex> guard(m_mutex);
+            if(m_nodeset.insert(node).second)
             {
-                lock_guard<mutex> guard(m_mutex);
-                auto it = find(m_links.begin(), m_links.end(), link);
-                if(it != m_links.end())
+                m_nodes.push_back(node);
+                if(m_running && !m_ntransactions)
                 {
-                    m_links.erase(it);
+                    node->index = (ulong)m_nodes.size();
+                    vector<sDspNode> nodes(1, node);
+                    try
+                    {
+                        compile(nodes);
+                    }
+                    catch(DspError& e)
+                    {
+                        throw e;
+                    }
+                    publish(set<sDspNode>());
                 }
             }
-            try
-            {
-                resume(state);
-            }
-            catch(DspError& e)
-            {
-                throw e;
-            }
         }
     }
     
-    void DspChain::sortNodes(set<sDspNode>& nodes, ulong& index, sDspNode node) throw(DspError&)
+    void DspChain::add(sDspLink link)  throw(DspError&)
     {
-        if(!node->index)
+        if(link && link->isValid())
         {
-            nodes.insert(node);
-            for(vector<sDspNode>::size_type i = 0; i < node->getNumberOfInputs(); i++)
+            shared_ptr<DspError> error;
             {
-                DspNodeSet& link = node->m_inputs[i]->m_links;
-                for(auto it = link.begin(); it != link.end(); ++it)
+                lock_guard<mutex> guard(m_mutex);
+                if(!m_linkset.insert(link).second)
+                {
+                    return;
+                }
+                m_links.push_back(link);
+                if(m_running && !m_ntransactions)
                 {
-                    sDspNode input = (*it).lock();
-                    if(input && !input->index)
+                    sDspNode from = link->getOutpuNode();
+                    sDspNode to   = link->getInputNode();
+                    set<sDspNode> nodes;
+                    try
+                    {
+                        if(!link->isFeedback() && from->index > to->index)
+                        {
+                            reorder(from, to);
+                        }
+                        m_index.build(m_nodes, m_links);
+                        
+                        // The readers of the output may have to stop sharing its vector.
+                        nodes.insert(to);
+                        if(link->isFeedback() || from->m_dead)
+                        {
+                            nodes.insert(from);
+                        }
+                        const DspIndex::Range readers = m_index.getReaders(from.get(), link->getOutputIndex());
+                        for(auto it = readers.begin(); it != readers.end(); ++it)
+                        {
+                            nodes.insert(it->node->shared_from_this());
+                        }
+                        restart(nodes);
+                    }
+                    catch(DspError& e)
                     {
-                        if(nodes.find(input) != nodes.end())
+                        // The link is undone and the nodes are restarted without it, so the plan covers the whole graph again.
+                        m_links.pop_back();
+                        m_linkset.erase(link);
+                        m_index.build(m_nodes, m_links);
+                        error = make_shared<DspError>(e);
+                        try
                         {
-                            throw DspError(input, DspError::Loop);
+                            restart(nodes);
                         }
-                        else
+                        catch(DspError&)
                         {
-                            sortNodes(nodes, index, input);
+                            m_recompile = true;
                         }
                     }
                 }
             }
-            
-            nodes.erase(node);
-            node->index = index++;
+            compact();
+            if(error)
+            {
+                throw *error;
+            }
         }
     }
     
-    bool DspChain::compareNodes(sDspNode const& node1, sDspNode const& node2)
-    {
-        return node1->index < node2->index;
-    }
-    
-    void DspChain::start() throw(DspError&)
+    void DspChain::remove(sDspNode node) throw(DspError&)
     {
-        if(m_running)
-        {
-            stop();
-        }
-        DspExpr expr("chain");
-        lock_guard<mutex> guard(m_mutex);
-        
-        for(vector<sDspLink>::size_type i = 0; i < m_links.size(); i++)
-        {
-            m_links[i]->start();
-        }
-        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
-        {
-            m_nodes[i]->index = 0;
-        }
-        
-        ulong index = 1;
-        set<sDspNode> temp;
-        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        if(node)
         {
-            try
-            {
-                sortNodes(temp, index, m_nodes[i]);
-            }
-            catch(DspError& e)
             {
-                throw e;
-            }
-        }
-        temp.clear();
-        
-        sort(m_nodes.begin(), m_nodes.end(), compareNodes);
-        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+                lock_guard<mutex> guard(m_mutex);
+                if(!m_nodeset.erase(node))
+                {
+                    return;
+                }
+                if(m_ntransactions)
+                {
+                    // The node keeps running until the transaction is committed, the links added before the removal are removed with it.
+                    m_removed[node.get()] = m_links.size();
+                    return;
+                }
+                m_nodes.erase(find(m_nodes.begin(), m_nodes.end(), node));
+                
+                // The readers of the node are collected while the index still has its links.
+                set<sDspNode> nodes;
+                for(ulong i = 0; i < node->getNumberOfOutputs(); i++)
+                {
+                    const DspIndex::Range readers = m_index.getReaders(node.get(), i);
+                    for(auto it = readers.begin(); it != readers.end(); ++it)
+                    {
+                        if(it->node != node.get())
+                        {
+                            nodes.insert(it->node->shared_from_this());
+                        }
+                    }
+                }
+                
+                // The node and the nodes that read it are withdrawn from the plan before the node is stopped.
+                if(m_running)
+                {
+                    expand(nodes);
+                    publish(nodes);
+                    nodes.erase(node);
+                }
+                for(auto lt = m_links.begin(); lt != m_links.end(); )
+                {
+                    if((*lt)->getOutpuNode() == node || (*lt)->getInputNode() == node)
+                    {
+                        m_linkset.erase(*lt);
+                        lt = m_links.erase(lt);
+                    }
+                    else
+                    {
+                        ++lt;
+                    }
+                }
+                node->stop();
+                for(ulong i = 0; i < node->getNumberOfInputs(); i++)
+                {
+                    node->m_inputs[i]->clear();
+                }
+                for(ulong i = 0; i < node->getNumberOfOutputs(); i++)
+                {
+                    node->m_outputs[i]->clear();
+                }
+                node->index = 0;
+                
+                if(m_running)
+                {
+                    m_index.build(m_nodes, m_links);
+                    for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+                    {
+                        m_nodes[i]->index = i + 1;
+                    }
+                    try
+                    {
+                        restart(nodes);
+                    }
+                    catch(DspError& e)
+                    {
+                        throw e;
+                    }
+                }
+            }
+            compact();
+        }
+    }
+    
+    void DspChain::remove(sDspLink link)  throw(DspError&)
+    {
+        if(link)
+        {
+            {
+                lock_guard<mutex> guard(m_mutex);
+                if(!m_linkset.erase(link))
+                {
+                    return;
+                }
+                if(m_ntransactions)
+                {
+                    return;
+                }
+                m_links.erase(find(m_links.begin(), m_links.end(), link));
+                
+                sDspNode from = link->getOutpuNode();
+                sDspNode to   = link->getInputNode();
+                if(from && to)
+                {
+                    if(m_running)
+                    {
+                        m_index.build(m_nodes, m_links);
+                        set<sDspNode> nodes;
+                        nodes.insert(to);
+                        try
+                        {
+                            restart(nodes);
+                        }
+                        catch(DspError& e)
+                        {
+                            throw e;
+                        }
+                    }
+                }
+            }
+            compact();
+        }
+    }
+    
+    void DspChain::begin()
+    {
+        lock_guard<mutex> guard(m_mutex);
+        if(!m_ntransactions++)
+        {
+            m_suspended = m_running;
+        }
+    }
+    
+    void DspChain::commit() throw(DspError&)
+    {
+        bool state = false;
+        {
+            lock_guard<mutex> guard(m_mutex);
+            if(!m_ntransactions || --m_ntransactions)
+            {
+                return;
+            }
+            
+            // The lists are rebuilt once from the indices, a node removed then added again is kept once.
+            unordered_set<DspNode*> visited;
+            vector<sDspNode> nodes;
+            for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+            {
+                if(visited.insert(m_nodes[i].get()).second)
+                {
+                    if(m_nodeset.count(m_nodes[i]))
+                    {
+                        nodes.push_back(m_nodes[i]);
+                    }
+                    else
+                    {
+                        m_detached.push_back(m_nodes[i]);
+                    }
+                }
+            }
+            m_nodes.swap(nodes);
+            
+            unordered_set<DspLink*> linked;
+            vector<sDspLink> links;
+            for(vector<sDspLink>::size_type i = 0; i < m_links.size(); i++)
+            {
+                const sDspLink& link = m_links[i];
+                const sDspNode from = link->getOutpuNode(), to = link->getInputNode();
+                auto ft = m_removed.find(from.get()), tt = m_removed.find(to.get());
+                if(!m_nodeset.count(from) || !m_nodeset.count(to) || (ft != m_removed.end() && i < ft->second) || (tt != m_removed.end() && i < tt->second))
+                {
+                    m_linkset.erase(link);
+                }
+                else if(m_linkset.count(link) && linked.insert(link.get()).second)
+                {
+                    links.push_back(link);
+                }
+            }
+            m_links.swap(links);
+            m_removed.clear();
+            state = m_suspended;
+            m_suspended = false;
+            if(!state)
+            {
+                detach();
+            }
+        }
+        
+        // The current plan keeps running until the new one replaces it.
+        if(state)
+        {
+            try
+            {
+                start();
+            }
+            catch(DspError& e)
+            {
+                throw e;
+            }
+        }
+    }
+    
+    void DspChain::reorder(sDspNode from, sDspNode to) throw(DspError&)
+    {
+        const ulong lower = to->index;
+        const ulong upper = from->index;
+        
+        // The nodes after the input node that are before the output node.
+        set<sDspNode> forward;
+        map<sDspNode, sDspNode> parents;
+        vector<sDspNode> stack(1, to);
+        forward.insert(to);
+        while(!stack.empty())
+        {
+            sDspNode node = stack.back();
+            stack.pop_back();
+            for(ulong i = 0; i < node->getNumberOfOutputs(); i++)
+            {
+                const DspIndex::Range readers = m_index.getReaders(node.get(), i);
+                for(auto it = readers.begin(); it != readers.end(); ++it)
+                {
+                    sDspNode next = it->node->shared_from_this();
+                    if(next->index <= upper && !it->feedback && forward.insert(next).second)
+                    {
+                        parents[next] = node;
+                        if(next == from)
+                        {
+                            // The loop goes from the output node to the input node with the new link, then back to the output node.
+                            vector<sDspNode> path(1, from);
+                            while(path.back() != to)
+                            {
+                                path.push_back(parents[path.back()]);
+                            }
+                            reverse(path.begin(), path.end());
+                            rotate(path.begin(), path.end() - 1, path.end());
+                            throw DspError(path, DspError::Loop);
+                        }
+                        stack.push_back(next);
+                    }
+                }
+            }
+        }
+        
+        // The nodes before the output node that are after the input node.
+        set<sDspNode> backward;
+        stack.push_back(from);
+        backward.insert(from);
+        while(!stack.empty())
+        {
+            sDspNode node = stack.back();
+            stack.pop_back();
+            for(ulong i = 0; i < node->getNumberOfInputs(); i++)
+            {
+                const DspIndex::Range sources = m_index.getSources(node.get(), i);
+                for(auto it = sources.begin(); it != sources.end(); ++it)
+                {
+                    sDspNode prev = it->node->shared_from_this();
+                    if(prev->index >= lower && !it->feedback && backward.insert(prev).second)
+                    {
+                        stack.push_back(prev);
+                    }
+                }
+            }
+        }
+        
+        // The backward nodes take the first indices of the pool, then the forward nodes.
+        vector<sDspNode> nodes(backward.begin(), backward.end());
+        sort(nodes.begin(), nodes.end(), compareNodes);
+        vector<sDspNode> after(forward.begin(), forward.end());
+        sort(after.begin(), after.end(), compareNodes);
+        vector<ulong> indices;
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+        {
+            indices.push_back(nodes[i]->index);
+        }
+        for(vector<sDspNode>::size_type i = 0; i < after.size(); i++)
+        {
+            indices.push_back(after[i]->index);
+            nodes.push_back(after[i]);
+        }
+        sort(indices.begin(), indices.end());
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
         {
-            if(m_nodes[i]->index)
+            nodes[i]->index = indices[i];
+            m_nodes[indices[i] - 1] = nodes[i];
+        }
+    }
+    
+    void DspChain::expand(set<sDspNode>& nodes) const
+    {
+        vector<sDspNode> stack(nodes.begin(), nodes.end());
+        while(!stack.empty())
+        {
+            sDspNode node = stack.back();
+            stack.pop_back();
+            for(ulong i = 0; i < node->getNumberOfOutputs(); i++)
             {
+                const DspIndex::Range readers = m_index.getReaders(node.get(), i);
+                for(auto it = readers.begin(); it != readers.end(); ++it)
+                {
+                    sDspNode next = it->node->shared_from_this();
+                    if(nodes.insert(next).second)
+                    {
+                        stack.push_back(next);
+                    }
+                }
+            }
+        }
+    }
+    
+    void DspChain::restart(set<sDspNode>& nodes) throw(DspError&)
+    {
+        // The nodes that read a restarted node are restarted because its vectors can change.
+        expand(nodes);
+        
+        // The other nodes keep running while the nodes are restarted.
+        publish(nodes);
+        for(auto it = nodes.begin(); it != nodes.end(); ++it)
+        {
+            if((*it)->m_dead || (*it)->m_latency || m_latency)
+            {
+                // The dead nodes haven't been started and the latencies change the delays of the other paths, the whole chain is recompiled now.
                 try
                 {
-                    m_nodes[i]->start();
+                    recompile();
                 }
                 catch(DspError& e)
                 {
                     throw e;
                 }
-                if(m_nodes[i]->isRunning())
+                return;
+            }
+            (*it)->m_constant = false;
+        }
+        vector<sDspNode> sorted(nodes.begin(), nodes.end());
+        sort(sorted.begin(), sorted.end(), compareNodes);
+        try
+        {
+            compile(sorted);
+        }
+        catch(DspError& e)
+        {
+            throw e;
+        }
+        publish(set<sDspNode>());
+    }
+    
+    void DspChain::publish(DspPlan* plan) noexcept
+    {
+        m_plan.publish(plan);
+    }
+    
+    bool DspChain::install(const DspPlan* plan) noexcept
+    {
+        long stage = DspPlan::pending;
+        if(!plan->m_stage.compare_exchange_strong(stage, DspPlan::installing, memory_order_acquire))
+        {
+            return stage == DspPlan::installed;
+        }
+        const ulong time = m_time.load(memory_order_relaxed);
+        for(vector<DspNode*>::size_type i = 0; i < plan->m_staged.size(); i++)
+        {
+            plan->m_staged[i]->install(m_samplerate, plan->m_vectorsize, &m_offset, time);
+        }
+        fold();
+        plan->m_stage.store(DspPlan::installed, memory_order_release);
+        return true;
+    }
+    
+    void DspChain::settle(const DspPlan* plan) noexcept
+    {
+        // If the audio thread doesn't tick, the chain installs the plan itself.
+        const ulong deadline = DspLoad::now() + 4ul * m_load.getPeriod();
+        while(plan->m_stage.load(memory_order_acquire) != DspPlan::installed)
+        {
+            if(DspLoad::now() < deadline || !install(plan))
+            {
+                this_thread::yield();
+            }
+        }
+    }
+    
+    void DspChain::publish(set<sDspNode> const& excluded)
+    {
+        DspPlan* plan = new DspPlan(m_nodes, m_index, excluded, m_vectorsize, m_nticks, m_pool, m_profiling);
+        m_nfused = plan->getNumberOfFusedNodes();
+        publish(plan);
+    }
+    
+    void DspChain::compile(vector<sDspNode>& nodes) throw(DspError&)
+    {
+        const ulong vectorsize = getVectorSize();
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+        {
+            for(ulong j = 0; j < nodes[i]->getNumberOfOutputs() && !nodes[i]->m_dead; j++)
+            {
+                if(nodes[i]->getCompiledOutput(j)->m_nfeedbacks)
                 {
-                    m_nodes[i]->getExpr(expr);
+                    try
+                    {
+                        nodes[i]->getCompiledOutput(j)->reserve(nodes[i], m_arena, m_index, vectorsize);
+                    }
+                    catch(DspError& e)
+                    {
+                        throw e;
+                    }
                 }
             }
         }
-        expr.post();
+        
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+        {
+            if(nodes[i]->index && !nodes[i]->m_dead)
+            {
+                try
+                {
+                    nodes[i]->start();
+                }
+                catch(DspError& e)
+                {
+                    throw e;
+                }
+            }
+        }
+    }
+    
+    void DspChain::compact() throw(DspError&)
+    {
+        if(m_running && !m_ntransactions && (m_recompile || m_arena.getSize() > 2ul * m_compiled + 65536ul))
+        {
+            try
+            {
+                start();
+            }
+            catch(DspError& e)
+            {
+                throw e;
+            }
+        }
+    }
+    
+    void DspChain::sortNodes() throw(DspError&)
+    {
+        const ulong size = (ulong)m_nodes.size();
+        unordered_map<DspNode*, ulong> positions;
+        for(ulong i = 0; i < size; i++)
+        {
+            m_nodes[i]->index = 0;
+            positions[m_nodes[i].get()] = i;
+        }
+        
+        // The sources of the nodes and their feedback readers in compressed rows.
+        vector<ulong> sources(1, 0ul), readers(1, 0ul), sedges, redges;
+        for(ulong i = 0; i < size; i++)
+        {
+            sDspNode node = m_nodes[i];
+            for(ulong j = 0; j < node->getNumberOfInputs(); j++)
+            {
+                const DspIndex::Range links = m_index.getSources(node.get(), j);
+                for(auto it = links.begin(); it != links.end(); ++it)
+                {
+                    auto position = positions.find(it->node);
+                    if(!it->feedback && position != positions.end())
+                    {
+                        sedges.push_back(position->second);
+                    }
+                }
+            }
+            for(ulong j = 0; j < node->getNumberOfOutputs(); j++)
+            {
+                const DspIndex::Range links = m_index.getReaders(node.get(), j);
+                for(auto it = links.begin(); it != links.end(); ++it)
+                {
+                    auto position = positions.find(it->node);
+                    if(it->feedback && position != positions.end())
+                    {
+                        redges.push_back(position->second);
+                    }
+                }
+            }
+            sources.push_back((ulong)sedges.size());
+            readers.push_back((ulong)redges.size());
+        }
+        
+        // A frame visits the sources of a node, then its feedback readers. A reader is visited speculatively, if it depends on a node that isn't sorted yet it's visited later.
+        struct Frame
+        {
+            ulong   node;
+            ulong   cursor;
+            bool    inputs;
+            bool    speculative;
+        };
+        vector<Frame>   stack;
+        vector<bool>    progress(size, false);
+        vector<ulong>   indices(size, 0ul);
+        ulong index = 1;
+        for(ulong i = 0; i < size; i++)
+        {
+            if(indices[i])
+            {
+                continue;
+            }
+            stack.push_back({i, sources[i], true, false});
+            progress[i] = true;
+            while(!stack.empty())
+            {
+                Frame& frame = stack.back();
+                const ulong node = frame.node;
+                if(frame.inputs)
+                {
+                    if(frame.cursor < sources[node + 1])
+                    {
+                        const ulong next = sedges[frame.cursor++];
+                        if(indices[next])
+                        {
+                            continue;
+                        }
+                        if(!progress[next])
+                        {
+                            stack.push_back({next, sources[next], true, false});
+                            progress[next] = true;
+                            continue;
+                        }
+                        
+                        // The node depends on a node in progress, it's a loop unless a speculative reader is in between.
+                        vector<Frame>::size_type first = stack.size() - 1;
+                        while(!(stack[first].node == next && stack[first].inputs))
+                        {
+                            first--;
+                        }
+                        vector<Frame>::size_type abort = stack.size();
+                        for(vector<Frame>::size_type j = first + 1; j < stack.size() && abort == stack.size(); j++)
+                        {
+                            if(stack[j].speculative)
+                            {
+                                abort = j;
+                            }
+                        }
+                        if(abort == stack.size())
+                        {
+                            vector<sDspNode> path;
+                            for(vector<Frame>::size_type j = stack.size(); j > first; j--)
+                            {
+                                path.push_back(m_nodes[stack[j - 1].node]);
+                            }
+                            throw DspError(path, DspError::Loop);
+                        }
+                        while(stack.size() > abort)
+                        {
+                            if(stack.back().inputs)
+                            {
+                                progress[stack.back().node] = false;
+                            }
+                            stack.pop_back();
+                        }
+                    }
+                    else
+                    {
+                        progress[node]  = false;
+                        frame.inputs    = false;
+                        frame.cursor    = readers[node];
+                    }
+                }
+                else if(frame.cursor < readers[node + 1])
+                {
+                    const ulong next = redges[frame.cursor++];
+                    if(!indices[next] && !progress[next])
+                    {
+                        stack.push_back({next, sources[next], true, true});
+                        progress[next] = true;
+                    }
+                }
+                else
+                {
+                    if(!indices[node])
+                    {
+                        indices[node] = index++;
+                    }
+                    stack.pop_back();
+                }
+            }
+        }
+        
+        for(ulong i = 0; i < size; i++)
+        {
+            m_nodes[i]->index = indices[i];
+        }
+        sort(m_nodes.begin(), m_nodes.end(), compareNodes);
+    }
+    
+    void DspChain::optimize()
+    {
+        const ulong size = (ulong)m_nodes.size();
+        unordered_map<DspNode*, ulong> positions;
+        vector<bool> sinks(size, false), pures(size, false);
+        for(ulong i = 0; i < size; i++)
+        {
+            DspExpr expr("node");
+            m_nodes[i]->getExpr(expr);
+            positions[m_nodes[i].get()] = i;
+            sinks[i] = expr.isSink() || !m_nodes[i]->getNumberOfOutputs();
+            // An equation is a description, only an explicit kernel replaces the perform method.
+            const bool resolved = expr.getEquation().empty() || expr.isBound();
+            m_nodes[i]->m_kernel = (expr.hasKernel() && resolved) ? expr.getKernel() : nullptr;
+            pures[i] = expr.isPure() && !sinks[i] && !m_nodes[i]->m_queue;
+            m_nodes[i]->m_dead      = true;
+            m_nodes[i]->m_constant  = false;
+        }
+        
+        // The nodes that reach a sink through the links are alive.
+        vector<ulong> stack;
+        for(ulong i = 0; i < size; i++)
+        {
+            if(sinks[i])
+            {
+                m_nodes[i]->m_dead = false;
+                stack.push_back(i);
+            }
+        }
+        while(!stack.empty())
+        {
+            sDspNode node = m_nodes[stack.back()];
+            stack.pop_back();
+            for(ulong i = 0; i < node->getNumberOfInputs(); i++)
+            {
+                const DspIndex::Range sources = m_index.getSources(node.get(), i);
+                for(auto it = sources.begin(); it != sources.end(); ++it)
+                {
+                    auto position = positions.find(it->node);
+                    if(it->node->m_dead && position != positions.end())
+                    {
+                        it->node->m_dead = false;
+                        stack.push_back(position->second);
+                    }
+                }
+            }
+        }
+        
+        // The pure nodes are constant if all their sources are constant, the sources are sorted before the nodes.
+        m_ndeads     = 0ul;
+        m_nconstants = 0ul;
+        for(ulong i = 0; i < size; i++)
+        {
+            sDspNode node = m_nodes[i];
+            if(node->m_dead)
+            {
+                m_ndeads++;
+            }
+            else if(pures[i])
+            {
+                bool constant = true;
+                for(ulong j = 0; j < node->getNumberOfInputs() && constant; j++)
+                {
+                    const DspIndex::Range sources = m_index.getSources(node.get(), j);
+                    for(auto it = sources.begin(); it != sources.end() && constant; ++it)
+                    {
+                        constant = !it->feedback && it->node->m_constant;
+                    }
+                }
+                if(constant)
+                {
+                    node->m_constant = true;
+                    m_nconstants++;
+                }
+            }
+        }
+    }
+    
+    void DspChain::compensate() noexcept
+    {
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            m_nodes[i]->m_arrival = 0ul;
+            for(ulong j = 0; j < m_nodes[i]->getNumberOfOutputs(); j++)
+            {
+                m_nodes[i]->getCompiledOutput(j)->m_delay = 0ul;
+            }
+        }
+        
+        // A node waits for its slowest source, the sources are sorted before the nodes.
+        m_latency = 0ul;
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            DspNode* node = m_nodes[i].get();
+            if(node->m_dead)
+            {
+                continue;
+            }
+            for(ulong j = 0; j < node->getNumberOfInputs() && !node->m_constant; j++)
+            {
+                const DspIndex::Range sources = m_index.getSources(node, j);
+                for(auto it = sources.begin(); it != sources.end(); ++it)
+                {
+                    if(!it->feedback && !it->node->m_constant && !it->node->m_dead)
+                    {
+                        node->m_arrival = max(node->m_arrival, it->node->m_arrival + it->node->m_latency);
+                    }
+                }
+            }
+            m_latency = max(m_latency, node->m_arrival + node->m_latency);
+        }
+        
+        // The outputs keep enough history for their most delayed reader.
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            DspNode* node = m_nodes[i].get();
+            for(ulong j = 0; j < node->getNumberOfInputs() && !node->m_dead; j++)
+            {
+                const DspIndex::Range sources = m_index.getSources(node, j);
+                for(auto it = sources.begin(); it != sources.end(); ++it)
+                {
+                    DspOutput* output = it->node->getCompiledOutput(it->port);
+                    output->m_delay = max(output->m_delay, DspInput::compensation(node, it->node, it->feedback));
+                }
+            }
+        }
+    }
+    
+    void DspChain::fold() noexcept
+    {
+        m_offset = 0ul;
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            if(m_nodes[i]->m_constant && m_nodes[i]->isRunning())
+            {
+                for(ulong j = 0; j < m_nodes[i]->m_nins; j++)
+                {
+                    m_nodes[i]->m_inputs[j]->perform();
+                }
+                m_nodes[i]->tick();
+            }
+        }
+    }
+    
+    bool DspChain::compareNodes(sDspNode const& node1, sDspNode const& node2)
+    {
+        return node1->index < node2->index;
+    }
+    
+    void DspChain::start() throw(DspError&)
+    {
+        lock_guard<mutex> guard(m_mutex);
+        try
+        {
+            recompile();
+        }
+        catch(DspError& e)
+        {
+            throw e;
+        }
+    }
+    
+    void DspChain::recompile() throw(DspError&)
+    {
+        DspExpr expr("chain");
+        
+        // The current plan keeps running while the chain is compiled, the nodes are compiled in their staged state.
+        ulong size = 0ul, hit = 0ul;
+        vector<ulong> key;
+        unordered_map<DspNode*, ulong> positions;
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            m_nodes[i]->m_staging = true;
+        }
+        try
+        {
+            m_index.build(m_nodes, m_links);
+            
+            // A known topology reuses the order and the memory size of its last compilation.
+            key = describe();
+            auto it = m_topologies.find(hash(key));
+            if(it != m_topologies.end() && it->second.key == key)
+            {
+                vector<sDspNode> nodes(m_nodes.size());
+                for(vector<ulong>::size_type i = 0; i < it->second.order.size(); i++)
+                {
+                    nodes[i] = m_nodes[it->second.order[i]];
+                    nodes[i]->index = (ulong)i + 1ul;
+                }
+                m_nodes.swap(nodes);
+                size = it->second.size;
+                hit  = it->first;
+                m_nhits++;
+                it->second.used = m_nhits + m_nmisses;
+            }
+            else
+            {
+                for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+                {
+                    positions[m_nodes[i].get()] = i;
+                }
+                sortNodes();
+                m_nmisses++;
+                
+                const ulong vectorsize = getVectorSize();
+                const ulong vsize = DspArena::align(vectorsize * sizeof(sample));
+                for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+                {
+                    for(ulong j = 0; j < m_nodes[i]->getNumberOfInputs(); j++)
+                    {
+                        const DspIndex::Range sources = m_index.getSources(m_nodes[i].get(), j);
+                        bool follows = false;
+                        for(auto it = sources.begin(); it != sources.end(); ++it)
+                        {
+                            follows = follows || it->node->getCompiledOutput(it->port)->m_nfeedbacks;
+                        }
+                        size += m_nodes[i]->m_inputs[j]->getNumberOfChannels() * vsize;
+                        size += 2 * DspArena::align(sources.size() * sizeof(sample *));
+                        if(follows)
+                        {
+                            size += 2 * DspArena::align((sources.size() + 2ul) * sizeof(sample **));
+                        }
+                    }
+                    for(ulong j = 0; j < m_nodes[i]->getNumberOfOutputs(); j++)
+                    {
+                        // An output read with a feedback link can swap two vectors.
+                        const ulong nvectors = m_nodes[i]->getCompiledOutput(j)->m_nfeedbacks ? 2ul : 1ul;
+                        size += nvectors * m_nodes[i]->m_outputs[j]->getNumberOfChannels() * vsize;
+                    }
+                }
+            }
+            optimize();
+        }
+        catch(DspError& e)
+        {
+            halt();
+            throw e;
+        }
+        
+        compensate();
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size() && !positions.empty(); i++)
+        {
+            for(ulong j = 0; j < m_nodes[i]->getNumberOfOutputs(); j++)
+            {
+                DspOutput* output = m_nodes[i]->getCompiledOutput(j);
+                if(output->m_delay)
+                {
+                    size += DspArena::align((output->m_delay + getVectorSize()) * output->getNumberOfChannels() * sizeof(sample));
+                }
+            }
+        }
+        
+        // The memory of the current plan is kept in the spare arena until the plan is replaced.
+        if(!m_spare.reserve(size))
+        {
+            halt();
+            throw DspError(nullptr, DspError::Alloc);
+        }
+        m_arena.swap(m_spare);
+        try
+        {
+            compile(m_nodes);
+        }
+        catch(DspError& e)
+        {
+            halt();
+            throw e;
+        }
+        
+        // The nodes that aren't started forget the vectors of their previous state.
+        const ulong vectorsize = getVectorSize();
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            DspNode* node = m_nodes[i].get();
+            for(ulong j = 0; (!node->index || node->m_dead) && j < node->getNumberOfInputs(); j++)
+            {
+                node->getCompiledInput(j)->start(nullptr, m_arena, m_index, vectorsize);
+            }
+            for(ulong j = 0; (!node->index || node->m_dead) && j < node->getNumberOfOutputs(); j++)
+            {
+                node->getCompiledOutput(j)->start(nullptr, m_arena, m_index, vectorsize);
+            }
+        }
+        
+        sDspContext context = getContext();
+        const ulong samplerate = context ? context->getSampleRate() : 0ul;
+        m_samplerate = samplerate;
+        m_vectorsize = vectorsize;
+        m_nticks     = (context && m_vectorsize) ? context->getVectorSize() / m_vectorsize : 1ul;
+        m_load.setPeriod(samplerate ? (ulong)(1e9 * (double)context->getVectorSize() / (double)samplerate) : 0ul);
+        
+        // The staged plan replaces the current one without gap, the audio thread installs the nodes between two blocks.
+        DspPlan* plan = new DspPlan(m_nodes, m_index, set<sDspNode>(), m_vectorsize, m_nticks, m_pool, m_profiling, true);
+        if(m_running)
+        {
+            publish(plan);
+            settle(plan);
+        }
+        else
+        {
+            install(plan);
+            delete plan;
+        }
+        detach();
+        m_spare.release();
+        m_compiled   = m_arena.getSize();
+        m_recompile  = false;
+        publish(set<sDspNode>());
         m_running = true;
+        
+        if(!positions.empty())
+        {
+            cache(key, positions);
+        }
+        else
+        {
+            // The nodes can allocate another memory size when they are prepared, the cached size follows the last compilation.
+            auto it = m_topologies.find(hit);
+            if(it != m_topologies.end())
+            {
+                it->second.size = m_compiled;
+            }
+        }
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            if(m_nodes[i]->isRunning())
+            {
+                m_nodes[i]->getExpr(expr);
+            }
+        }
+        expr.post();
+    }
+    
+    vector<ulong> DspChain::describe() const noexcept
+    {
+        unordered_map<DspNode*, ulong> positions;
+        vector<ulong> key;
+        key.push_back(getVectorSize());
+        key.push_back(getSampleRate());
+        key.push_back(m_nodes.size());
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            DspNode* node = m_nodes[i].get();
+            positions[node] = i;
+            key.push_back(typeid(*node).hash_code());
+            key.push_back(node->getNumberOfInputs());
+            key.push_back(node->getNumberOfOutputs());
+            key.push_back(node->m_latency);
+            for(ulong j = 0; j < node->getNumberOfInputs(); j++)
+            {
+                key.push_back(node->m_inputs[j]->getNumberOfChannels());
+            }
+            for(ulong j = 0; j < node->getNumberOfOutputs(); j++)
+            {
+                key.push_back(node->m_outputs[j]->getNumberOfChannels());
+            }
+        }
+        key.push_back(m_links.size());
+        for(vector<sDspLink>::size_type i = 0; i < m_links.size(); i++)
+        {
+            sDspNode from = m_links[i]->getOutpuNode(), to = m_links[i]->getInputNode();
+            auto it = from ? positions.find(from.get()) : positions.end();
+            auto jt = to ? positions.find(to.get()) : positions.end();
+            key.push_back(it != positions.end() ? it->second : ~0ul);
+            key.push_back(m_links[i]->getOutputIndex());
+            key.push_back(jt != positions.end() ? jt->second : ~0ul);
+            key.push_back(m_links[i]->getInputIndex());
+            key.push_back(m_links[i]->isFeedback());
+        }
+        return key;
+    }
+    
+    ulong DspChain::hash(vector<ulong> const& key) noexcept
+    {
+        ulong value = 14695981039346656037ul;
+        for(vector<ulong>::size_type i = 0; i < key.size(); i++)
+        {
+            value = (value ^ key[i]) * 1099511628211ul;
+        }
+        return value;
+    }
+    
+    void DspChain::cache(vector<ulong> const& key, unordered_map<DspNode*, ulong> const& positions)
+    {
+        Topology topology;
+        topology.size = m_arena.getSize();
+        topology.used = m_nhits + m_nmisses;
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            topology.order.push_back(positions.find(m_nodes[i].get())->second);
+        }
+        
+        // The sorted order is also stored, so restarting the same chain is a hit.
+        for(ulong k = 0; k < 2ul; k++)
+        {
+            topology.key = k ? describe() : key;
+            const ulong value = hash(topology.key);
+            
+            // The cache is small, the patches usually toggle between a few configurations.
+            if(m_topologies.size() >= 16ul && !m_topologies.count(value))
+            {
+                auto oldest = m_topologies.begin();
+                for(auto it = m_topologies.begin(); it != m_topologies.end(); ++it)
+                {
+                    if(it->second.used < oldest->second.used)
+                    {
+                        oldest = it;
+                    }
+                }
+                m_topologies.erase(oldest);
+            }
+            m_topologies[value] = topology;
+            for(vector<ulong>::size_type i = 0; i < topology.order.size(); i++)
+            {
+                topology.order[i] = i;
+            }
+        }
+    }
+    
+    void DspChain::clearCache() noexcept
+    {
+        lock_guard<mutex> guard(m_mutex);
+        m_topologies.clear();
+    }
+    
+    future<void> DspChain::startAsync()
+    {
+        sDspChain chain = shared_from_this();
+        return async(launch::async, [chain]()
+        {
+            chain->start();
+        });
     }
     
     void DspChain::stop()
@@ -278,16 +1648,47 @@ namespace Kiwi
         {
             m_running = false;
             lock_guard<mutex> guard(m_mutex);
-            for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+            halt();
+        }
+    }
+    
+    void DspChain::halt()
+    {
+        m_running = false;
+        publish(nullptr);
+        detach();
+        for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+        {
+            m_nodes[i]->stop();
+            m_nodes[i]->m_staging = false;
+        }
+        m_arena.release();
+        m_spare.release();
+        m_index.clear();
+    }
+    
+    void DspChain::detach()
+    {
+        for(vector<sDspNode>::size_type i = 0; i < m_detached.size(); i++)
+        {
+            sDspNode node = m_detached[i];
+            node->stop();
+            for(ulong j = 0; j < node->getNumberOfInputs(); j++)
+            {
+                node->m_inputs[j]->clear();
+            }
+            for(ulong j = 0; j < node->getNumberOfOutputs(); j++)
             {
-                m_nodes[i]->stop();
+                node->m_outputs[j]->clear();
             }
+            node->index = 0;
         }
+        m_detached.clear();
     }
     
     void DspChain::resume(const bool state) throw(DspError&)
     {
-        if(state && !m_running)
+        if(state && !m_running && !m_ntransactions)
         {
             try
             {
@@ -25,6 +25,11 @@
 #define __DEF_KIWI_DSP_CHAIN__
 
 #include "KiwiDspNode.h"
+#include "KiwiDspPool.h"
+#include "KiwiDspSnapshot.h"
+#include "KiwiDspIndex.h"
+#include "KiwiDspLoad.h"
+#include <future>
 
 // TODO :
 // - Check thread safety
@@ -33,6 +38,152 @@
 // - Clean The errors
 namespace Kiwi
 {
+    // ================================================================================ //
+    //                                      DSP PLAN                                    //
+    // ================================================================================ //
+    
+    //! The dsp plan is the flat list of operations processed by the audio thread.
+    /**
+     The dsp plan is built by the chain each time the chain is compiled or edited and is published to the audio thread with an atomic swap, the audio thread picks it up at the beginning of the next block. The plan resolves the work of the nodes into a contiguous array of operations: the merges of the inputs that sum several signals and the process calls of the nodes, the nodes that don't perform and the inputs that read the vector of their source directly are removed. The runs of elementwise nodes that describe their process with a kernel are merged into one kernel evaluated in a single loop. If the chain has a pool of threads, the operations of each node form a task and the tasks are ordered by the links so the independent branches run concurrently, small graphs and graphs without branches stay serial. A plan never changes once it has been published, a staged plan only records that the nodes have been installed. The previous plan is deleted by the thread that publishes the new one.
+     */
+    class DspPlan
+    {
+        friend DspChain;
+        friend DspPool;
+    private:
+        struct Operation
+        {
+            void (*method)(void* target);
+            void* target;
+        };
+        
+        struct Fusion
+        {
+            DspKernel               kernel;
+            vector<const sample*>   inputs;
+            sample*                 output;
+            DspOutput*              signal;
+            ulong                   size;
+        };
+        
+        struct Probe
+        {
+            const Operation*    begin;
+            const Operation*    end;
+            DspNode*            node;
+        };
+        
+        struct Task
+        {
+            ulong begin;
+            ulong end;
+            ulong npredecessors;
+        };
+        
+        vector<Operation>                   m_operations;
+        ulong                               m_nnodes;
+        const ulong                         m_vectorsize;
+        const ulong                         m_nticks;
+        const shared_ptr<DspPool>           m_pool;
+        bool                                m_parallel;
+        ulong                               m_nfused;
+        vector<unique_ptr<Fusion>>          m_fusions;
+        vector<Operation>                   m_probed;
+        vector<Probe>                       m_probes;
+        vector<Task>                        m_tasks;
+        vector<ulong>                       m_offsets;
+        vector<ulong>                       m_successors;
+        vector<ulong>                       m_roots;
+        vector<unique_ptr<DspTaskQueue>>    m_queues;
+        unique_ptr<atomic<ulong>[]>         m_counters;
+        mutable atomic<long>                m_remaining;
+        vector<DspNode*>                    m_staged;
+        mutable atomic<long>                m_stage;
+        
+        static const long pending    = 0l;
+        static const long installing = 1l;
+        static const long installed  = 2l;
+        
+        static bool isFusable(DspNode const* node) noexcept;
+        static void fuse(void* fusion) noexcept;
+        static void merge(void* input) noexcept;
+        static void swap(void* output) noexcept;
+        static void tick(void* node) noexcept;
+        static void perform(void* node) noexcept;
+        static void launch(void* node) noexcept;
+        static void probe(void* probe) noexcept;
+        
+        //! Perform the operations once.
+        /** The function calls the operations of the plan in order.
+         */
+        inline void tick() const noexcept
+        {
+            const Operation* op = m_operations.data();
+            const Operation* end = op + m_operations.size();
+            for(; op != end; ++op)
+            {
+                op->method(op->target);
+            }
+        }
+        
+        //! Prepare a parallel pass.
+        /** The function resets the counters of the tasks and pushes the tasks without predecessor in the queue of the thread that ticks the chain. It must be called before the workers are woken, the workers that are still leaving the previous pass of the plan only find the tasks of the new one.
+         */
+        void prepare() const noexcept;
+        
+        //! Perform the tasks of a parallel pass.
+        /** The function pops the tasks of the queue of a thread or steals the tasks of the other threads until all the tasks of the pass are done.
+         @param index The index of the queue of the thread.
+         */
+        void work(const ulong index) const noexcept;
+    public:
+        
+        //! Constructor.
+        /** The function resolves the operations of the sorted nodes of the chain that are running and that are not excluded. A staged plan is built while the nodes are staged and installs their staged state before its first tick, it doesn't know yet which nodes will run so it processes all the nodes that the chain starts, checks at each block that they run and doesn't fuse them.
+         @param nodes       The sorted nodes of the chain.
+         @param index       The index of the links of the chain.
+         @param excluded    The nodes that are being restarted and mustn't be processed.
+         @param vectorsize  The vector size of the nodes.
+         @param nticks      The number of ticks per vector of the context.
+         @param pool        The pool of threads or nullptr to perform serially, the plan keeps it alive.
+         @param profile     If the operations of each node are timed.
+         @param staged      If the plan installs the staged state of the nodes.
+         */
+        DspPlan(vector<sDspNode> const& nodes, DspIndex const& index, set<sDspNode> const& excluded, const ulong vectorsize, const ulong nticks, shared_ptr<DspPool> pool = nullptr, const bool profile = false, const bool staged = false);
+        
+        //! Destructor.
+        /** The function waits until the workers of the pool have left the plan, it must not be called by the thread that ticks the chain.
+         */
+        ~DspPlan();
+        
+        //! Retrieve the number of nodes.
+        /** The function retrieves the number of nodes processed by the plan.
+         @return The number of nodes.
+         */
+        inline ulong getNumberOfNodes() const noexcept
+        {
+            return m_nnodes;
+        }
+        
+        //! Retrieve the number of fused nodes.
+        /** The function retrieves the number of nodes that are performed by a merged kernel.
+         @return The number of fused nodes.
+         */
+        inline ulong getNumberOfFusedNodes() const noexcept
+        {
+            return m_nfused;
+        }
+        
+        //! Retrieve the number of operations.
+        /** The function retrieves the number of operations of the plan.
+         @return The number of operations.
+         */
+        inline ulong getNumberOfOperations() const noexcept
+        {
+            return (ulong)m_operations.size();
+        }
+    };
+    
     // ================================================================================ //
     //                                      DSP CHAIN                                   //
     // ================================================================================ //
@@ -44,33 +195,201 @@ namespace Kiwi
     class DspChain: public inheritable_enable_shared_from_this<DspChain>
     {
         friend DspContext;
+        friend DspNode;
         
     private:
         wDspContext         m_context;
         vector<sDspNode>    m_nodes;
         vector<sDspLink>    m_links;
+        DspArena            m_arena;
+        DspArena            m_spare;
+        DspIndex            m_index;
         mutable mutex       m_mutex;
         atomic_bool         m_running;
+        ulong               m_blocksize;
+        ulong               m_samplerate;
+        ulong               m_vectorsize;
+        ulong               m_nticks;
+        ulong               m_offset;
+        ulong               m_compiled;
+        shared_ptr<DspPool> m_pool;
+        atomic_ulong        m_time;
+        ulong               m_ndeads;
+        ulong               m_nconstants;
+        bool                m_recompile;
+        ulong               m_nfused;
+        ulong               m_latency;
+        DspLoad             m_load;
+        bool                m_profiling;
+        DspSnapshot<DspPlan> m_plan;
+        
+        //! The result of the compilation of a topology.
+        struct Topology
+        {
+            vector<ulong>   key;
+            vector<ulong>   order;
+            ulong           size;
+            ulong           used;
+        };
+        
+        unordered_set<sDspNode> m_nodeset;
+        unordered_set<sDspLink> m_linkset;
+        unordered_map<DspNode*, ulong> m_removed;
+        vector<sDspNode>    m_detached;
+        ulong               m_ntransactions;
+        bool                m_suspended;
+        unordered_map<ulong, Topology> m_topologies;
+        ulong               m_nhits;
+        ulong               m_nmisses;
+        
+        //! Describe the topology.
+        /** The function describes the block size, the sample rate, the types, the latencies and the ports of the nodes and the links in their current order. Two chains with the same description are sorted the same way and use about the same memory, the memory that the nodes allocate when they are prepared is checked after each compilation.
+         @return The description of the topology.
+         */
+        vector<ulong> describe() const noexcept;
+        
+        //! Hash the description of a topology.
+        /** The function combines the values of a description with the FNV-1a constants.
+         @param key The description.
+         @return The hash.
+         */
+        static ulong hash(vector<ulong> const& key) noexcept;
+        
+        //! Cache the compilation of a topology.
+        /** The function stores the order of the sorted nodes and the memory used by the compilation. When the cache is full, the topology that has been used the least recently is evicted.
+         @param key         The description of the topology before the sort.
+         @param positions   The positions of the nodes before the sort.
+         */
+        void cache(vector<ulong> const& key, unordered_map<DspNode*, ulong> const& positions);
+        
+        //! Sort the nodes.
+        /** The function sorts the nodes of the chain with an iterative depth-first search over a compact index of the links, the readers of a feedback link are placed before its source when they don't depend on it. If the links generate a loop, the error contains all the nodes of the loop.
+         */
+        void sortNodes() throw(DspError&);
+        
+        //! Move the nodes so a link can be added.
+        /** The function moves the nodes between the input node and the output node of a new link so the order of the nodes stays valid. Only the nodes between the two nodes are moved.
+         @param from The output node of the link.
+         @param to   The input node of the link.
+         */
+        void reorder(sDspNode from, sDspNode to) throw(DspError&);
+        
+        //! Add the readers of a set of nodes.
+        /** The function adds to the set the nodes that read the nodes of the set, directly or through other nodes.
+         @param nodes The nodes.
+         */
+        void expand(set<sDspNode>& nodes) const;
+        
+        //! Restart a set of nodes.
+        /** The function restarts a set of nodes and the nodes that read them, the other nodes keep running. If one of the nodes was removed by the optimizer or if the chain has latencies, the whole chain is recompiled at once.
+         @param nodes The nodes to restart.
+         */
+        void restart(set<sDspNode>& nodes) throw(DspError&);
+        
+        //! Compile the whole chain.
+        /** The function sorts, optimizes and compiles all the nodes then replaces the current plan. If the chain is running, the nodes are compiled in their staged state while the current plan keeps running, then a staged plan replaces it and installs the new state between two blocks. The mutex of the chain must be locked.
+         */
+        void recompile() throw(DspError&);
+        
+        //! Start a sorted list of nodes.
+        /** The function allocates the signals of the nodes and calls their prepare method.
+         @param nodes The nodes to start.
+         */
+        void compile(vector<sDspNode>& nodes) throw(DspError&);
+        
+        //! Optimize the sorted nodes.
+        /** The function marks the nodes that don't reach a sink as dead so they aren't started and the pure nodes that are only fed by constants as constant so they are evaluated once, the declarations are retrieved from the expressions of the nodes.
+         */
+        void optimize();
+        
+        //! Evaluate the constant nodes.
+        /** The function performs once the constant nodes after they have been started, their vectors then keep the values.
+         */
+        void fold() noexcept;
+        
+        //! Compensate the latencies of the nodes.
+        /** The function computes the time at which the signals arrive at each node and the delay that each output must keep so the shorter paths are aligned on the slowest one.
+         */
+        void compensate() noexcept;
+        
+        //! Recompile the chain if the arena wastes too much memory.
+        /** The function recompiles the whole chain when the incremental edits have used more than twice the memory of the last compilation or when an edit couldn't be undone.
+         */
+        void compact() throw(DspError&);
+        
+        //! Stop the processing.
+        /** The function withdraws the plan from the audio thread, stops the nodes and releases the memory of the chain. The mutex must be locked.
+         */
+        void halt();
+        
+        //! Stop the nodes removed by a transaction.
+        /** The function stops the nodes that a committed transaction has removed, the plan that processes them must have been withdrawn.
+         */
+        void detach();
+        
+        //! Publish a new plan to the audio thread.
+        /** The function swaps the plan processed by the audio thread, waits until the audio thread has left the previous plan and deletes it. It must never be called from the audio thread.
+         @param plan The new plan or nullptr to stop the processing.
+         */
+        void publish(DspPlan* plan) noexcept;
         
-        void sortNodes(set<sDspNode>& nodes, ulong& index, sDspNode node) throw(DspError&);
+        //! Publish a plan that doesn't process a set of nodes.
+        /** The function publishes a plan with all the nodes of the chain except the excluded ones.
+         @param excluded The nodes that mustn't be processed.
+         */
+        void publish(set<sDspNode> const& excluded);
         
         static bool compareNodes(sDspNode const& node1, sDspNode const& node2);
         
-        //! Perform a tick on the dsp chain.
-        /** The function calls once all the node methods of the dsp nodes.
+        //! Install the staged state of the nodes.
+        /** The function switches the nodes to the state that has been compiled for a staged plan and performs the constant nodes. Only the first caller installs the plan, the audio thread calls it at the first tick of the plan and the chain calls it if the audio thread doesn't tick.
+         @param plan The staged plan.
+         @return true if the plan is installed, false if another thread is installing it.
          */
-        inline void tick() const noexcept
+        bool install(const DspPlan* plan) noexcept;
+        
+        //! Wait until a staged plan is installed.
+        /** The function waits for the audio thread to install a published staged plan, the plan is installed by the chain after a few periods without tick.
+         @param plan The staged plan.
+         */
+        void settle(const DspPlan* plan) noexcept;
+        
+        //! Perform a plan on the dsp chain.
+        /** The function processes a plan of the chain for all the ticks of a vector of the context.
+         @param plan The plan.
+         */
+        inline void run(const DspPlan* plan) noexcept
         {
-            lock_guard<mutex> guard(m_mutex);
-            for(vector<sDspNode>::size_type i = 0; i < m_nodes.size(); i++)
+            m_offset = 0ul;
+            for(ulong j = 0; j < plan->m_nticks; j++, m_offset += plan->m_vectorsize)
             {
-                if(m_nodes[i]->isRunning())
+                if(plan->m_parallel)
+                {
+                    plan->m_pool->perform(plan);
+                }
+                else
                 {
-                    m_nodes[i]->tick();
+                    plan->tick();
                 }
+                m_time.store(m_time.load(memory_order_relaxed) + plan->m_vectorsize, memory_order_relaxed);
             }
         }
         
+        //! Perform a tick on the dsp chain.
+        /** The function processes the current plan of the chain. The audio thread never waits for a compilation, a staged plan is installed at its first tick.
+         */
+        inline void tick() noexcept
+        {
+            const DspPlan* plan = m_plan.acquire();
+            if(plan && (plan->m_stage.load(memory_order_acquire) == DspPlan::installed || install(plan)))
+            {
+                const ulong start = DspLoad::now();
+                run(plan);
+                m_load.add(DspLoad::now() - start);
+            }
+            m_plan.release();
+        }
+        
     public:
         
         //! The constructor.
@@ -106,11 +425,151 @@ namespace Kiwi
         ulong getSampleRate() const noexcept;
         
         //! Retrieve the vector size of the chain.
-        /** This function retrieves the vector size of the chain.
+        /** This function retrieves the vector size of the chain, it is the block size of the chain if it has been set or the vector size of the context.
          @return The vector size of the chain.
          */
         ulong getVectorSize() const noexcept;
         
+        //! Retrieve the block size requested for the chain.
+        /** This function retrieves the block size requested for the chain, zero means that the chain uses the vector size of the context.
+         @return The block size requested.
+         */
+        inline ulong getBlockSize() const noexcept
+        {
+            return m_blocksize;
+        }
+        
+        //! Set the block size of the chain.
+        /** This function sets a block size smaller than the vector size of the context, the chain is then ticked several times per vector of the context. The block size is only used if it divides the vector size of the context, zero means that the chain uses the vector size of the context. The method re-computes the dsp chain if it is running, inside a transaction the chain is re-computed when the transaction is committed.
+         @param blocksize The block size.
+         */
+        void setBlockSize(const ulong blocksize) throw(DspError&);
+        
+        //! Retrieve the number of threads of the chain.
+        /** This function retrieves the number of worker threads that perform the independent branches of the chain, zero means that the chain is performed serially by the thread of the device.
+         @return The number of threads.
+         */
+        inline ulong getNumberOfThreads() const noexcept
+        {
+            return m_pool ? m_pool->getNumberOfThreads() : 0ul;
+        }
+        
+        //! Set the number of threads of the chain.
+        /** This function creates a pool of worker threads that perform the independent branches of the chain with the thread of the device, zero performs the chain serially. The nodes that write in a memory shared with other nodes, such as the outputs of the device, must then synchronize their accesses. The workers can be pinned to a list of cores, the worker i runs on the core cores[i % cores.size()], by default the system chooses the cores. The method re-computes the dsp chain if it is running, inside a transaction the chain is re-computed when the transaction is committed.
+         @param nthreads The number of worker threads.
+         @param cores    The cores of the workers.
+         */
+        void setNumberOfThreads(const ulong nthreads, vector<ulong> const& cores = vector<ulong>()) throw(DspError&);
+        
+        //! Retrieve the offset of the current block.
+        /** This function retrieves the position of the block that is processed in the vector of the context. It should be used by the nodes that read or write the vectors of the device.
+         @return The offset of the current block.
+         */
+        inline ulong getOffset() const noexcept
+        {
+            return m_offset;
+        }
+        
+        //! Retrieve the sample time of the chain.
+        /** This function retrieves the number of samples processed by the chain, it can be called from any thread to timestamp the events of the nodes.
+         @return The sample time of the chain.
+         */
+        inline ulong getTime() const noexcept
+        {
+            return m_time.load(memory_order_relaxed);
+        }
+        
+        //! Retrieve the number of dead nodes.
+        /** This function retrieves the number of nodes that have been removed by the last compilation because they don't reach a sink.
+         @return The number of dead nodes.
+         */
+        inline ulong getNumberOfDeadNodes() const noexcept
+        {
+            return m_ndeads;
+        }
+        
+        //! Retrieve the number of constant nodes.
+        /** This function retrieves the number of nodes that have been evaluated once and removed by the last compilation because they only depend on constants.
+         @return The number of constant nodes.
+         */
+        inline ulong getNumberOfConstantNodes() const noexcept
+        {
+            return m_nconstants;
+        }
+        
+        //! Set if the nodes are profiled.
+        /** This function sets if the chain uses a plan that counts the cycles spent by each node, the plan without profile doesn't pay any cost. The profiles of the nodes are cleared when the profiling starts.
+         @param status The profiling status.
+         */
+        void setProfiling(const bool status);
+        
+        //! Check if the nodes are profiled.
+        /** This function checks if the chain uses a plan that counts the cycles spent by each node.
+         @return True if the nodes are profiled, otherwise false.
+         */
+        inline bool isProfiling() const noexcept
+        {
+            return m_profiling;
+        }
+        
+        //! Retrieve the profile of the nodes.
+        /** This function retrieves the nodes of the chain sorted by the number of cycles they spent while the chain was profiled, the most expensive first.
+         @return The sorted nodes.
+         */
+        vector<sDspNode> getProfile() const;
+        
+        //! Retrieve the load of the chain.
+        /** This function retrieves the histogram of the durations of the ticks of the chain, it can be read from any thread.
+         @return The load of the chain.
+         */
+        inline DspLoad const& getLoad() const noexcept
+        {
+            return m_load;
+        }
+        
+        //! Retrieve the latency of the chain.
+        /** This function retrieves the number of samples between the sources and the end of the slowest path of the chain, once the dsp is started.
+         @return The latency of the chain.
+         */
+        inline ulong getLatency() const noexcept
+        {
+            return m_latency;
+        }
+        
+        //! Retrieve the number of fused nodes.
+        /** This function retrieves the number of elementwise nodes that are performed by a merged kernel in the current plan.
+         @return The number of fused nodes.
+         */
+        inline ulong getNumberOfFusedNodes() const noexcept
+        {
+            return m_nfused;
+        }
+        
+        //! Retrieve the number of cache hits.
+        /** This function retrieves the number of compilations that have reused the order and the memory size of a known topology.
+         @return The number of cache hits.
+         */
+        inline ulong getNumberOfCacheHits() const noexcept
+        {
+            lock_guard<mutex> guard(m_mutex);
+            return m_nhits;
+        }
+        
+        //! Retrieve the number of cache misses.
+        /** This function retrieves the number of compilations that have sorted an unknown topology.
+         @return The number of cache misses.
+         */
+        inline ulong getNumberOfCacheMisses() const noexcept
+        {
+            lock_guard<mutex> guard(m_mutex);
+            return m_nmisses;
+        }
+        
+        //! Clear the cache of the topologies.
+        /** This function removes the topologies known by the chain.
+         */
+        void clearCache() noexcept;
+        
         //! Check if the chain is compiled.
         /** This function checks if the chain is compiled.
          @return True if the chain is compiled otherwise it returns false.
@@ -127,38 +586,54 @@ namespace Kiwi
         inline ulong getNumberOfNodes() const noexcept
         {
             lock_guard<mutex> guard(m_mutex);
-            return (ulong)m_nodes.size();
+            return (ulong)m_nodeset.size();
         }
         
         //! Add a node to the dsp chain.
-        /** The function adds a node to the dsp chain.
+        /** The function adds a node to the dsp chain. If the chain is running, only the new node is started but the plan is rebuilt, so the cost is linear in the number of nodes and links of the chain.
          @param node The node to add.
          */
         void add(sDspNode node)  throw(DspError&);
         
         //! Add a link to the dsp chain.
-        /** The function adds a link to the dsp chain.
+        /** The function adds a link to the dsp chain. If the chain is running, the order of the nodes is updated locally and only the input node, the readers of the output and the nodes that depend on them are restarted. The index of the links is rebuilt, so the cost is linear in the number of nodes and links of the chain.
          @param link The link to add.
          */
         void add(sDspLink link)  throw(DspError&);
         
         //! Remove a node from the dsp chain.
-        /** The function removes a node from the dsp chain.
+        /** The function removes a node and its links from the dsp chain. If the chain is running, only the nodes that depend on the node are restarted. The index of the links is rebuilt and the nodes are renumbered, so the cost is linear in the number of nodes and links of the chain.
          @param node The node to remove.
          */
         void remove(sDspNode node)  throw(DspError&);
         
         //! Remove a link to the dsp chain.
-        /** The function removes a link to the dsp chain.
+        /** The function removes a link to the dsp chain. If the chain is running, only the input node and the nodes that depend on it are restarted. The index of the links is rebuilt, so the cost is linear in the number of nodes and links of the chain.
          @param link The link to remove.
          */
         void remove(sDspLink link)  throw(DspError&);
         
+        //! Begin a transaction.
+        /** The function starts a transaction, the nodes and the links added or removed until the transaction is committed are only recorded so a large patch is loaded in linear time. The current plan keeps running during the transaction. The transactions can be nested, only the outermost one is committed.
+         */
+        void begin();
+        
+        //! Commit a transaction.
+        /** The function applies the removals recorded by the transaction and, if the chain was running when the transaction began, compiles the chain once and replaces the current plan with a single publication. If the links generate a loop, the chain stays stopped and the error is thrown.
+         */
+        void commit() throw(DspError&);
+        
         //! Compile the dsp chain.
-        /** The function sorts the dsp nodes and call the dsp methods of the nodes.
+        /** The function sorts the dsp nodes and call the dsp methods of the nodes. If the chain is running, the current plan keeps running while the nodes are sorted, optimized and compiled, then the new plan replaces it without skipping a block. The prepare methods of the nodes are then called between two blocks by the audio thread.
          */
         void start() throw(DspError&);
         
+        //! Compile the dsp chain in a background thread.
+        /** The function compiles the chain in a new thread, the audio thread keeps running the other chains and picks the new plan up at the next block. The errors of the compilation are thrown by the get method of the future.
+         @return The future of the compilation.
+         */
+        future<void> startAsync();
+        
         //! Stop the dsp.
         /** The function call the stop the dsp of all the nodes.
          */
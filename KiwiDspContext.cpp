@@ -32,7 +32,6 @@ namespace Kiwi
     
     DspContext::DspContext(sDspDeviceManager device) noexcept :
     m_device(device),
-    m_cpu_factor(0.),
     m_running(false)
     {
         
@@ -44,6 +43,7 @@ namespace Kiwi
         {
             stop();
         }
+        m_snapshot.publish(nullptr);
         m_chains.clear();
     }
     
@@ -81,6 +81,7 @@ namespace Kiwi
             if(find(m_chains.begin(), m_chains.end(), chain) == m_chains.end())
             {
                 m_chains.push_back(chain);
+                publish();
             }
         }
     }
@@ -95,6 +96,7 @@ namespace Kiwi
             if(it != m_chains.end())
             {
                 m_chains.erase(it);
+                publish();
                 finded = true;
             }
         }
@@ -104,6 +106,16 @@ namespace Kiwi
         }
     }
     
+    void DspContext::publish() noexcept
+    {
+        vector<DspChain*>* chains = new vector<DspChain*>();
+        for(vector<sDspChain>::size_type i = 0; i < m_chains.size(); i++)
+        {
+            chains->push_back(m_chains[i].get());
+        }
+        m_snapshot.publish(chains);
+    }
+    
     void DspContext::start()
     {
         sDspDeviceManager device = m_device.lock();
@@ -115,7 +127,8 @@ namespace Kiwi
             }
             device->add(shared_from_this());
             m_running = true;
-            m_cpu_factor = 10e-6 * (double)getSampleRate() / (double)getVectorSize();
+            const ulong samplerate = getSampleRate();
+            m_load.setPeriod(samplerate ? (ulong)(1e9 * (double)getVectorSize() / (double)samplerate) : 0ul);
         }
     }
     
@@ -44,26 +44,35 @@ namespace Kiwi
         const wDspDeviceManager m_device;
         vector<sDspChain>       m_chains;
         mutable mutex           m_mutex;
-        mutable double          m_cpu;
-        double                  m_cpu_factor;
+        mutable DspSnapshot<vector<DspChain*>> m_snapshot;
+        
+        //! Publish the snapshot of the chains.
+        /** The function publishes the current list of chains to the audio thread, the mutex must be locked.
+         */
+        void publish() noexcept;
+        mutable DspLoad         m_load;
         atomic_bool             m_running;
         
         //! Perform a tick on the dsp context.
-        /** The function calls once all the node methods of the dsp chains.
+        /** The function calls once all the node methods of the dsp chains. It reads the snapshot of the chains so it never waits for the threads that add or remove a chain.
          */
         inline void tick() const noexcept
         {
-            auto start = std::chrono::high_resolution_clock::now();
-            lock_guard<mutex> guard(m_mutex);
-            for(vector<sDspChain>::size_type i = 0; i < m_chains.size(); i++)
+            const ulong start = DspLoad::now();
+            const vector<DspChain*>* chains = m_snapshot.acquire();
+            if(chains)
             {
-                if(m_chains[i]->isRunning())
+                for(vector<DspChain*>::size_type i = 0; i < chains->size(); i++)
                 {
-                    m_chains[i]->tick();
+                    if((*chains)[i]->isRunning())
+                    {
+                        (*chains)[i]->tick();
+                    }
                 }
             }
-            auto end = std::chrono::high_resolution_clock::now();
-            m_cpu = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+            m_snapshot.release();
+            m_load.add(DspLoad::now() - start);
         }
         
     public:
@@ -120,12 +129,21 @@ namespace Kiwi
         }
         
         //! Retrieve the CPU of the context.
-        /** The function retrieves the CPU of the context.
+        /** The function retrieves the mean duration of the recent ticks of the context relative to the duration of a block.
          @return The CPU of the context in percent.
          */
         inline double getCPU() const noexcept
         {
-            return m_cpu * m_cpu_factor;
+            return m_load.getLoad() * 100.;
+        }
+        
+        //! Retrieve the load of the context.
+        /** The function retrieves the histogram of the durations of the ticks of the context, it can be read from any thread.
+         @return The load of the context.
+         */
+        inline DspLoad const& getLoad() const noexcept
+        {
+            return m_load;
         }
         
         //! Add a chain to the dsp context.
@@ -37,9 +37,20 @@ namespace Kiwi
     DspDeviceManager::~DspDeviceManager() noexcept
     {
         lock_guard<mutex> guard(m_mutex);
+        m_snapshot.publish(nullptr);
         m_contexts.clear();
     }
     
+    void DspDeviceManager::publish() noexcept
+    {
+        vector<DspContext*>* contexts = new vector<DspContext*>();
+        for(vector<sDspContext>::size_type i = 0; i < m_contexts.size(); i++)
+        {
+            contexts->push_back(m_contexts[i].get());
+        }
+        m_snapshot.publish(contexts);
+    }
+    
     void DspDeviceManager::add(sDspContext context)
     {
         if(context)
@@ -48,6 +59,7 @@ namespace Kiwi
             if(find(m_contexts.begin(), m_contexts.end(), context) == m_contexts.end())
             {
                 m_contexts.push_back(context);
+                publish();
             }
         }
     }
@@ -61,6 +73,7 @@ namespace Kiwi
             if(it != m_contexts.end())
             {
                 m_contexts.erase(it);
+                publish();
             }
         }
     }
@@ -37,22 +37,32 @@ namespace Kiwi
     private:
         vector<sDspContext> m_contexts;
         mutable mutex       m_mutex;
+        mutable DspSnapshot<vector<DspContext*>> m_snapshot;
+        
+        //! Publish the snapshot of the contexts.
+        /** The function publishes the current list of contexts to the audio thread, the mutex must be locked.
+         */
+        void publish() noexcept;
         
     protected:
         
         //! The tick function to call at each dsp cycle.
-        /** The function ticks all the contexts.
+        /** The function ticks all the contexts. It reads the snapshot of the contexts so it never waits for the threads that add or remove a context.
          */
         inline void tick() const noexcept
         {
-            lock_guard<mutex> guard(m_mutex);
-            for(vector<sDspContext>::size_type i = 0; i < m_contexts.size(); i++)
+            const vector<DspContext*>* contexts = m_snapshot.acquire();
+            if(contexts)
             {
-                if(m_contexts[i]->isRunning())
+                for(vector<DspContext*>::size_type i = 0; i < contexts->size(); i++)
                 {
-                    m_contexts[i]->tick();
+                    if((*contexts)[i]->isRunning())
+                    {
+                        (*contexts)[i]->tick();
+                    }
                 }
             }
+            m_snapshot.release();
         }
         
     public:
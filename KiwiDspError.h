@@ -45,10 +45,12 @@ namespace Kiwi
             Inplace    = 1, ///< Indicates that an output can't find the input signal for inplace processing.
             Alloc      = 2, ///< Indicates that the a signal has not been allocated.
             Loop       = 3, ///< Indicates a loop between two nodes.
+            Channels   = 4, ///< Indicates that a link connects an output and an input with different numbers of channels.
         };
     private:
-        const Type      m_type;
-        const wDspNode  m_node;
+        const Type          m_type;
+        const wDspNode      m_node;
+        vector<wDspNode>    m_path;
     public:
         
         //! Constructor.
@@ -60,6 +62,16 @@ namespace Kiwi
         {
             ;
         }
+        
+        //! Constructor.
+        /** The method creates a new error with the nodes of a loop, the first node is the node that generates the error.
+         @param path    The nodes of the loop in the order of the signal.
+         @param type    The type of the error.
+         */
+        DspError(vector<sDspNode> const& path, Type const& type) noexcept : m_type(type), m_node(path.empty() ? nullptr : path[0]), m_path(path.begin(), path.end())
+        {
+            ;
+        }
         //! Destructor.
         /** The method does nothing.
          */
@@ -85,6 +97,9 @@ namespace Kiwi
                 case Alloc:
                     return "A node can't allocate its signal.";
                     break;
+                case Channels:
+                    return "A link connects an output and an input with different numbers of channels.";
+                    break;
                 default:
                     return "Two nodes generate a loop.";
                     break;
@@ -108,6 +123,20 @@ namespace Kiwi
         {
             return m_node.lock();
         }
+        
+        //! Retrieve the nodes of the loop.
+        /** The method retrieves the nodes of the loop that generates the error in the order of the signal, each node is linked to the next one and the last node is linked to the first one.
+         @return The nodes of the loop or an empty vector if the error isn't a loop.
+         */
+        inline vector<sDspNode> getPath() const noexcept
+        {
+            vector<sDspNode> path;
+            for(vector<wDspNode>::size_type i = 0; i < m_path.size(); i++)
+            {
+                path.push_back(m_path[i].lock());
+            }
+            return path;
+        }
     };
 }
 
@@ -0,0 +1,171 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_EVENT__
+#define __DEF_KIWI_DSP_EVENT__
+
+#include "KiwiDspSignal.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP EVENT                                   //
+    // ================================================================================ //
+    
+    //! The dsp event is a timestamped message for a node.
+    /**
+     The dsp event owns the time of the message in samples, an index that the node uses to identify the parameter and a value. The time is in the sample time of the chain (see DspChain::getTime), when the node receives the event the time is the offset of the event in the current block.
+     */
+    struct DspEvent
+    {
+        ulong   time;
+        ulong   index;
+        sample  value;
+    };
+    
+    // ================================================================================ //
+    //                                      DSP EVENT QUEUE                             //
+    // ================================================================================ //
+    
+    //! The dsp event queue transfers the events from the control threads to the dsp thread.
+    /**
+     The dsp event queue is a bounded lock-free queue, several threads can push events and the dsp thread pops them without locking and without allocation.
+     */
+    class DspEventQueue
+    {
+    private:
+        struct Cell
+        {
+            atomic<ulong>   sequence;
+            DspEvent        event;
+        };
+        
+        Cell*           m_cells;
+        const ulong     m_mask;
+        atomic<ulong>   m_write;
+        atomic<ulong>   m_read;
+        
+        static inline ulong round(ulong size) noexcept
+        {
+            ulong capacity = 2ul;
+            while(capacity < size)
+            {
+                capacity <<= 1;
+            }
+            return capacity;
+        }
+        
+    public:
+        
+        //! Constructor.
+        /** The function allocates the queue, the capacity is rounded to the next power of two.
+         @param size The capacity of the queue.
+         */
+        DspEventQueue(const ulong size) :
+        m_cells(new Cell[round(size)]),
+        m_mask(round(size) - 1ul),
+        m_write(0ul),
+        m_read(0ul)
+        {
+            for(ulong i = 0; i <= m_mask; i++)
+            {
+                m_cells[i].sequence.store(i, memory_order_relaxed);
+            }
+        }
+        
+        //! Destructor.
+        /** The function frees the queue.
+         */
+        ~DspEventQueue()
+        {
+            delete [] m_cells;
+        }
+        
+        //! Retrieve the capacity of the queue.
+        /** The function retrieves the maximum number of events in the queue.
+         @return The capacity.
+         */
+        inline ulong getCapacity() const noexcept
+        {
+            return m_mask + 1ul;
+        }
+        
+        //! Push an event in the queue.
+        /** The function pushes an event in the queue, it can be called from any thread.
+         @param event The event.
+         @return true if the event has been pushed, false if the queue is full.
+         */
+        inline bool push(DspEvent const& event) noexcept
+        {
+            ulong pos = m_write.load(memory_order_relaxed);
+            while(true)
+            {
+                Cell& cell = m_cells[pos & m_mask];
+                const ulong seq = cell.sequence.load(memory_order_acquire);
+                const long  dif = (long)seq - (long)pos;
+                if(dif == 0)
+                {
+                    if(m_write.compare_exchange_weak(pos, pos + 1ul, memory_order_relaxed))
+                    {
+                        cell.event = event;
+                        cell.sequence.store(pos + 1ul, memory_order_release);
+                        return true;
+                    }
+                }
+                else if(dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_write.load(memory_order_relaxed);
+                }
+            }
+        }
+        
+        //! Pop an event from the queue.
+        /** The function pops the oldest event of the queue, it should only be called from the dsp thread.
+         @param event The event.
+         @return true if an event has been popped, false if the queue is empty.
+         */
+        inline bool pop(DspEvent& event) noexcept
+        {
+            const ulong pos = m_read.load(memory_order_relaxed);
+            Cell& cell = m_cells[pos & m_mask];
+            const ulong seq = cell.sequence.load(memory_order_acquire);
+            if((long)seq - (long)(pos + 1ul) < 0)
+            {
+                return false;
+            }
+            event = cell.event;
+            cell.sequence.store(pos + m_mask + 1ul, memory_order_release);
+            m_read.store(pos + 1ul, memory_order_relaxed);
+            return true;
+        }
+    };
+}
+
+
+#endif
+
+
@@ -21,29 +21,617 @@
  ==============================================================================
 */
 
+
 #include "KiwiDspExpr.h"
 
+#include <iomanip>
+#include <limits>
+
 namespace Kiwi
 {
-    ostream& operator<<(ostream &output, const DspExpr &expr)
+    // ================================================================================ //
+    //                                      DSP TERM                                    //
+    // ================================================================================ //
+    
+    namespace
     {
+        struct DspFunction
+        {
+            const char*     name;
+            DspKernel::Code code;
+        };
+        
+        const DspFunction functions[] =
+        {
+            {"abs", DspKernel::Abs}, {"sqrt", DspKernel::Sqrt}, {"exp", DspKernel::Exp}, {"log", DspKernel::Log},
+            {"sin", DspKernel::Sin}, {"cos", DspKernel::Cos}, {"tanh", DspKernel::Tanh}, {"floor", DspKernel::Floor},
+            {"min", DspKernel::Min}, {"max", DspKernel::Max}, {"pow", DspKernel::Pow}
+        };
+        
+        sample evaluate(DspKernel::Code code, const sample a, const sample b) noexcept
+        {
+            switch(code)
+            {
+                case DspKernel::Add:    return a + b;
+                case DspKernel::Sub:    return a - b;
+                case DspKernel::Mul:    return a * b;
+                case DspKernel::Div:    return a / b;
+                case DspKernel::Min:    return a < b ? a : b;
+                case DspKernel::Max:    return a > b ? a : b;
+                case DspKernel::Pow:    return pow(a, b);
+                case DspKernel::Neg:    return -a;
+                case DspKernel::Abs:    return fabs(a);
+                case DspKernel::Sqrt:   return sqrt(a);
+                case DspKernel::Exp:    return exp(a);
+                case DspKernel::Log:    return log(a);
+                case DspKernel::Sin:    return sin(a);
+                case DspKernel::Cos:    return cos(a);
+                case DspKernel::Tanh:   return tanh(a);
+                case DspKernel::Floor:  return floor(a);
+                default:                return a;
+            }
+        }
         
-        return output;
+        //! The parser reads an equation with a recursive descent, each level of precedence is a method.
+        class DspParser
+        {
+        private:
+            const char* m_text;
+            
+            void skip() noexcept
+            {
+                while(*m_text == ' ' || *m_text == '\t' || *m_text == '\n' || *m_text == '\r')
+                {
+                    m_text++;
+                }
+            }
+            
+            bool accept(const char c) noexcept
+            {
+                skip();
+                if(*m_text == c)
+                {
+                    m_text++;
+                    return true;
+                }
+                return false;
+            }
+            
+            // The inputs and the variables can be written as functions of the time, x(t) is x.
+            void time() noexcept
+            {
+                const char* text = m_text;
+                if(!(accept('(') && accept('t') && accept(')')))
+                {
+                    m_text = text;
+                }
+            }
+            
+            DspTerm primary()
+            {
+                skip();
+                if(accept('('))
+                {
+                    DspTerm term = sum();
+                    return accept(')') ? term : DspTerm();
+                }
+                if(isdigit(*m_text) || *m_text == '.')
+                {
+                    char* end = nullptr;
+                    const double value = strtod(m_text, &end);
+                    if(end == m_text)
+                    {
+                        return DspTerm();
+                    }
+                    m_text = end;
+                    return DspTerm::constant(sample(value));
+                }
+                string name;
+                while(isalnum(*m_text) || *m_text == '_')
+                {
+                    name += *m_text++;
+                }
+                if(name.empty())
+                {
+                    return DspTerm();
+                }
+                if(name[0] == 'x' && name.find_first_not_of("0123456789", 1) == string::npos)
+                {
+                    time();
+                    return DspTerm::input(name.size() > 1 ? stoul(name.substr(1)) : 0ul);
+                }
+                if(name == "pi")
+                {
+                    return DspTerm::constant(sample(3.14159265358979323846));
+                }
+                for(const DspFunction& function : functions)
+                {
+                    if(name == function.name)
+                    {
+                        if(!accept('('))
+                        {
+                            return DspTerm();
+                        }
+                        DspTerm a = sum(), b;
+                        if(DspKernel::isBinary(function.code) && !(accept(',') && (b = sum()).isValid()))
+                        {
+                            return DspTerm();
+                        }
+                        return accept(')') ? DspTerm::apply(function.code, a, b) : DspTerm();
+                    }
+                }
+                if(name == "clip")
+                {
+                    DspTerm a, low, high;
+                    if(accept('(') && (a = sum()).isValid() && accept(',') && (low = sum()).isValid() && accept(',') && (high = sum()).isValid() && accept(')'))
+                    {
+                        return DspTerm::apply(DspKernel::Min, DspTerm::apply(DspKernel::Max, a, low), high);
+                    }
+                    return DspTerm();
+                }
+                if(name.size() == 1ul && name[0] != 't')
+                {
+                    time();
+                    return DspTerm::variable(name[0]);
+                }
+                return DspTerm();
+            }
+            
+            DspTerm power()
+            {
+                DspTerm term = primary();
+                if(term.isValid() && accept('^'))
+                {
+                    return DspTerm::apply(DspKernel::Pow, term, unary());
+                }
+                return term;
+            }
+            
+            DspTerm unary()
+            {
+                if(accept('-'))
+                {
+                    return -unary();
+                }
+                if(accept('+'))
+                {
+                    return unary();
+                }
+                return power();
+            }
+            
+            DspTerm product()
+            {
+                DspTerm term = unary();
+                while(term.isValid())
+                {
+                    if(accept('*'))
+                    {
+                        term = term * unary();
+                    }
+                    else if(accept('/'))
+                    {
+                        term = term / unary();
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                return term;
+            }
+            
+        public:
+            DspParser(const char* text) noexcept : m_text(text)
+            {
+                ;
+            }
+            
+            DspTerm sum()
+            {
+                DspTerm term = product();
+                while(term.isValid())
+                {
+                    if(accept('+'))
+                    {
+                        term = term + product();
+                    }
+                    else if(accept('-'))
+                    {
+                        term = term - product();
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                return term;
+            }
+            
+            bool finished() noexcept
+            {
+                skip();
+                return *m_text == '\0';
+            }
+        };
+    }
+    
+    DspTerm::DspTerm() noexcept
+    {
+        ;
+    }
+    
+    DspTerm::DspTerm(shared_ptr<const Node> node) noexcept : m_node(node)
+    {
+        ;
+    }
+    
+    DspTerm DspTerm::make(DspKernel::Code code, const sample value, const ulong index, const char name, DspTerm const& a, DspTerm const& b)
+    {
+        return DspTerm(make_shared<const Node>(Node({code, value, index, name, a.m_node, b.m_node})));
+    }
+    
+    DspTerm DspTerm::input(const ulong index)
+    {
+        return make(DspKernel::Input, 0., index, '\0', DspTerm(), DspTerm());
+    }
+    
+    DspTerm DspTerm::constant(const sample value)
+    {
+        return make(DspKernel::Constant, value, 0ul, '\0', DspTerm(), DspTerm());
+    }
+    
+    DspTerm DspTerm::variable(const char name)
+    {
+        return make(DspKernel::Variable, 0., 0ul, name, DspTerm(), DspTerm());
+    }
+    
+    DspTerm DspTerm::apply(DspKernel::Code code, DspTerm const& a, DspTerm const& b)
+    {
+        if(code <= DspKernel::Variable || !a.isValid() || (DspKernel::isBinary(code) && !b.isValid()))
+        {
+            return DspTerm();
+        }
+        return make(code, 0., 0ul, '\0', a, DspKernel::isBinary(code) ? b : DspTerm());
+    }
+    
+    DspTerm DspTerm::parse(string const& equation)
+    {
+        const string::size_type equal = equation.find('=');
+        DspParser parser(equation.c_str() + (equal == string::npos ? 0 : equal + 1));
+        DspTerm term = parser.sum();
+        return parser.finished() ? term : DspTerm();
+    }
+    
+    DspTerm operator+(DspTerm const& a, DspTerm const& b)
+    {
+        return DspTerm::apply(DspKernel::Add, a, b);
+    }
+    
+    DspTerm operator-(DspTerm const& a, DspTerm const& b)
+    {
+        return DspTerm::apply(DspKernel::Sub, a, b);
+    }
+    
+    DspTerm operator*(DspTerm const& a, DspTerm const& b)
+    {
+        return DspTerm::apply(DspKernel::Mul, a, b);
+    }
+    
+    DspTerm operator/(DspTerm const& a, DspTerm const& b)
+    {
+        return DspTerm::apply(DspKernel::Div, a, b);
+    }
+    
+    DspTerm operator-(DspTerm const& a)
+    {
+        return DspTerm::apply(DspKernel::Neg, a);
+    }
+    
+    DspTerm DspTerm::simplify() const
+    {
+        return simplify(m_node);
+    }
+    
+    DspTerm DspTerm::simplify(shared_ptr<const Node> const& node)
+    {
+        if(!node || node->code <= DspKernel::Variable)
+        {
+            return DspTerm(node);
+        }
+        const bool binary = DspKernel::isBinary(node->code);
+        DspTerm a = simplify(node->a);
+        DspTerm b = binary ? simplify(node->b) : DspTerm();
+        if(a.isConstant() && (!binary || b.isConstant()))
+        {
+            return constant(evaluate(node->code, a.getValue(), b.getValue()));
+        }
+        
+        // The constant operand of the commutative operations is moved to the right.
+        if((node->code == DspKernel::Add || node->code == DspKernel::Mul) && a.isConstant())
+        {
+            swap(a, b);
+        }
+        const bool constant = b.isConstant();
+        const sample value = b.getValue();
+        int exponent = 0;
+        switch(node->code)
+        {
+            case DspKernel::Add:
+                if(constant && value == 0.)
+                {
+                    return a;
+                }
+                if(constant && a.m_node->code == DspKernel::Add && DspTerm(a.m_node->b).isConstant())
+                {
+                    return simplify((DspTerm(a.m_node->a) + DspTerm::constant(a.m_node->b->value + value)).m_node);
+                }
+                if(b.m_node->code == DspKernel::Neg)
+                {
+                    return a - DspTerm(b.m_node->a);
+                }
+                break;
+            case DspKernel::Sub:
+                if(a.isConstant() && a.getValue() == 0.)
+                {
+                    return simplify((-b).m_node);
+                }
+                if(constant)
+                {
+                    return simplify((a + DspTerm::constant(-value)).m_node);
+                }
+                if(b.m_node->code == DspKernel::Neg)
+                {
+                    return a + DspTerm(b.m_node->a);
+                }
+                break;
+            case DspKernel::Mul:
+                if(constant && value == 1.)
+                {
+                    return a;
+                }
+                if(constant && value == -1.)
+                {
+                    return simplify((-a).m_node);
+                }
+                if(constant && a.m_node->code == DspKernel::Mul && DspTerm(a.m_node->b).isConstant())
+                {
+                    return simplify((DspTerm(a.m_node->a) * DspTerm::constant(a.m_node->b->value * value)).m_node);
+                }
+                break;
+            case DspKernel::Div:
+                if(constant && isfinite(value) && frexp(value, &exponent) == sample(0.5))
+                {
+                    // The reciprocal of a power of two is exact so the division and the multiplication give the same results.
+                    return simplify((a * DspTerm::constant(sample(1.) / value)).m_node);
+                }
+                break;
+            case DspKernel::Pow:
+                if(constant && value == 0.)
+                {
+                    return DspTerm::constant(1.);
+                }
+                if(constant && value == 1.)
+                {
+                    return a;
+                }
+                if(constant && value == 2.)
+                {
+                    return a * a;
+                }
+                break;
+            case DspKernel::Neg:
+                if(a.m_node->code == DspKernel::Neg)
+                {
+                    return DspTerm(a.m_node->a);
+                }
+                break;
+            default:
+                break;
+        }
+        return apply(node->code, a, b);
+    }
+    
+    ulong DspTerm::compile(DspKernel& kernel, map<char, const sample*> const& variables) const
+    {
+        if(!m_node)
+        {
+            return kernel.constant(0.);
+        }
+        return compile(m_node, kernel, variables);
+    }
+    
+    bool DspTerm::isBound(map<char, const sample*> const& variables) const noexcept
+    {
+        return !m_node || isBound(m_node, variables);
+    }
+    
+    bool DspTerm::isBound(shared_ptr<const Node> const& node, map<char, const sample*> const& variables) noexcept
+    {
+        if(!node)
+        {
+            return true;
+        }
+        if(node->code == DspKernel::Variable)
+        {
+            auto it = variables.find(node->name);
+            return it != variables.end() && it->second;
+        }
+        return isBound(node->a, variables) && isBound(node->b, variables);
+    }
+    
+    ulong DspTerm::compile(shared_ptr<const Node> const& node, DspKernel& kernel, map<char, const sample*> const& variables)
+    {
+        switch(node->code)
+        {
+            case DspKernel::Input:
+                return kernel.input(node->index);
+            case DspKernel::Constant:
+                return kernel.constant(node->value);
+            case DspKernel::Variable:
+            {
+                auto it = variables.find(node->name);
+                return (it != variables.end() && it->second) ? kernel.variable(it->second) : kernel.constant(0.);
+            }
+            default:
+            {
+                const ulong a = compile(node->a, kernel, variables);
+                if(DspKernel::isBinary(node->code))
+                {
+                    // A shared operand, such as the one of x * x, is computed once.
+                    const ulong b = node->b == node->a ? a : compile(node->b, kernel, variables);
+                    return kernel.apply(node->code, a, b);
+                }
+                return kernel.apply(node->code, a);
+            }
+        }
+    }
+    
+    string DspTerm::toString() const
+    {
+        // The constants are written with enough digits to be parsed back to the same value.
+        ostringstream output;
+        output << setprecision(numeric_limits<sample>::max_digits10);
+        write(output, m_node);
+        return output.str();
+    }
+    
+    void DspTerm::write(ostream& output, shared_ptr<const Node> const& node)
+    {
+        if(!node)
+        {
+            return;
+        }
+        // The operands are always written between parentheses so the string can be parsed again.
+        switch(node->code)
+        {
+            case DspKernel::Input:
+                output << "x" << node->index;
+                break;
+            case DspKernel::Constant:
+                output << node->value;
+                break;
+            case DspKernel::Variable:
+                output << node->name;
+                break;
+            case DspKernel::Add:
+            case DspKernel::Sub:
+            case DspKernel::Mul:
+            case DspKernel::Div:
+            case DspKernel::Pow:
+            {
+                const char operators[] = {'+', '-', '*', '/', '\0', '\0', '^'};
+                output << "(";
+                write(output, node->a);
+                output << " " << operators[node->code - DspKernel::Add] << " ";
+                write(output, node->b);
+                output << ")";
+            }
+                break;
+            case DspKernel::Neg:
+                output << "-";
+                write(output, node->a);
+                break;
+            default:
+                for(const DspFunction& function : functions)
+                {
+                    if(function.code == node->code)
+                    {
+                        output << function.name << "(";
+                        write(output, node->a);
+                        if(node->b)
+                        {
+                            output << ", ";
+                            write(output, node->b);
+                        }
+                        output << ")";
+                    }
+                }
+                break;
+        }
+    }
+    
+    ostream& operator<<(ostream &output, const DspTerm &term)
+    {
+        return output << term.toString();
+    }
+    
+    // ================================================================================ //
+    //                                      DSP MATH                                    //
+    // ================================================================================ //
+    
+    bool DspExpr::setEquation(const string& equation) noexcept
+    {
+        m_equation = equation;
+        try
+        {
+            m_term = DspTerm::parse(equation).simplify();
+        }
+        catch(exception&)
+        {
+            m_term = DspTerm();
+        }
+        return m_term.isValid();
+    }
+    
+    void DspExpr::setTerm(DspTerm const& term) noexcept
+    {
+        try
+        {
+            m_term = term.simplify();
+            m_equation = m_term.toString();
+        }
+        catch(exception&)
+        {
+            m_term = DspTerm();
+        }
+    }
+    
+    void DspExpr::addVariable(const char name, const sample* value) noexcept
+    {
+        m_variables[name] = value;
+    }
+    
+    bool DspExpr::compile(DspKernel& kernel) const
+    {
+        if(!m_term.isValid() || !m_term.isBound(m_variables))
+        {
+            return false;
+        }
+        kernel.setResult(m_term.compile(kernel, m_variables));
+        return true;
+    }
+    
+    shared_ptr<const DspKernel> DspExpr::getKernel() const
+    {
+        if(m_kernel || !m_term.isValid())
+        {
+            return m_kernel;
+        }
+        shared_ptr<DspKernel> kernel = make_shared<DspKernel>();
+        if(!compile(*kernel))
+        {
+            // An unbound variable would be read as zero, the kernel wouldn't match the process.
+            return nullptr;
+        }
+        return kernel;
+    }
+    
+    void DspExpr::post() const noexcept
+    {
+        for(vector<DspExpr>::size_type i = 0; i < m_exprs.size(); i++)
+        {
+            m_exprs[i].post();
+        }
+        cout << *this << endl;
+    }
+    
+    ostream& operator<<(ostream &output, const DspExpr &expr)
+    {
+        const DspTerm term = expr.getTerm();
+        return output << "y_" + expr.getName() + "(t) = " + (term.isValid() ? term.toString() : expr.getEquation());
     }
 }
 
 
 
-
-
-
-
-
-
-
-
-
-
-
-
-
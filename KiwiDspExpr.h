@@ -21,49 +21,198 @@
  ==============================================================================
 */
 
+
 #ifndef __DEF_KIWI_DSP_EXPR__
 #define __DEF_KIWI_DSP_EXPR__
 
 #include "KiwiDspError.h"
+#include "KiwiDspKernel.h"
 
 namespace Kiwi
 {
+    // ================================================================================ //
+    //                                      DSP TERM                                    //
+    // ================================================================================ //
+    
+    //! The term is a node of the syntax tree of a mathematical expression.
+    /**
+     The term is an immutable tree of operations on the inputs, the constants and the named variables of a process. The terms are shared so copying a term is cheap, they can be built with the operators, parsed from a string, simplified and compiled into a kernel.
+     */
+    class DspTerm
+    {
+    private:
+        struct Node
+        {
+            DspKernel::Code         code;
+            sample                  value;
+            ulong                   index;
+            char                    name;
+            shared_ptr<const Node>  a;
+            shared_ptr<const Node>  b;
+        };
+        
+        shared_ptr<const Node> m_node;
+        
+        DspTerm(shared_ptr<const Node> node) noexcept;
+        static DspTerm make(DspKernel::Code code, const sample value, const ulong index, const char name, DspTerm const& a, DspTerm const& b);
+        static DspTerm simplify(shared_ptr<const Node> const& node);
+        static void write(ostream& output, shared_ptr<const Node> const& node);
+        static ulong compile(shared_ptr<const Node> const& node, DspKernel& kernel, map<char, const sample*> const& variables);
+        static bool isBound(shared_ptr<const Node> const& node, map<char, const sample*> const& variables) noexcept;
+    public:
+        
+        //! Constructor.
+        /** The function initializes an empty term.
+         */
+        DspTerm() noexcept;
+        
+        //! Create an input term.
+        /** The function creates a term that reads an input of the process.
+         @param index The index of the input.
+         @return The term.
+         */
+        static DspTerm input(const ulong index);
+        
+        //! Create a constant term.
+        /** The function creates a term that holds a constant value.
+         @param value The value.
+         @return The term.
+         */
+        static DspTerm constant(const sample value);
+        
+        //! Create a variable term.
+        /** The function creates a term that reads a named variable, the address of the variable is bound by the expression.
+         @param name The name of the variable.
+         @return The term.
+         */
+        static DspTerm variable(const char name);
+        
+        //! Create an operation term.
+        /** The function creates a term that applies an operation to one or two terms.
+         @param code The code of the operation.
+         @param a    The first term.
+         @param b    The second term if the operation is binary.
+         @return The term or an empty term if an operand is empty.
+         */
+        static DspTerm apply(DspKernel::Code code, DspTerm const& a, DspTerm const& b = DspTerm());
+        
+        //! Parse a term.
+        /** The function parses an equation such as "y(t) = sin(x0(t) * g) + 0.5". The inputs are named x or x0, x1..., the single letters are variables, the functions are abs, sqrt, exp, log, sin, cos, tanh, floor, min, max, pow and clip, and the constant pi is known.
+         @param equation The equation.
+         @return The term or an empty term if the equation isn't valid.
+         */
+        static DspTerm parse(string const& equation);
+        
+        //! Check if the term is valid.
+        /** The function checks if the term isn't empty.
+         @return True if the term is valid otherwise false.
+         */
+        inline bool isValid() const noexcept
+        {
+            return bool(m_node);
+        }
+        
+        //! Check if the term is a constant.
+        /** The function checks if the term is a constant.
+         @return True if the term is a constant otherwise false.
+         */
+        inline bool isConstant() const noexcept
+        {
+            return m_node && m_node->code == DspKernel::Constant;
+        }
+        
+        //! Retrieve the value of a constant term.
+        /** The function retrieves the value of a constant term.
+         @return The value or zero if the term isn't a constant.
+         */
+        inline sample getValue() const noexcept
+        {
+            return isConstant() ? m_node->value : sample(0.);
+        }
+        
+        //! Simplify the term.
+        /** The function folds the constant operations, removes the neutral elements such as x + 0 or x * 1 and the double negations, and merges the constants of the chains of additions and multiplications. The absorbing elements such as x * 0 are kept because the result isn't zero if x is infinite or not a number.
+         @return The simplified term.
+         */
+        DspTerm simplify() const;
+        
+        //! Check if the variables of the term are bound.
+        /** The function checks if every variable of the term has an address.
+         @param variables   The addresses of the variables.
+         @return True if all the variables are bound otherwise false.
+         */
+        bool isBound(map<char, const sample*> const& variables) const noexcept;
+        
+        //! Compile the term.
+        /** The function appends the instructions of the term to a kernel, the variables that aren't bound are replaced by zero so the kernel should only be used if the term is bound (see isBound).
+         @param kernel      The kernel.
+         @param variables   The addresses of the variables.
+         @return The register of the result.
+         */
+        ulong compile(DspKernel& kernel, map<char, const sample*> const& variables) const;
+        
+        //! Retrieve the term as a string.
+        /** The function writes the term with the infix notation.
+         @return The string.
+         */
+        string toString() const;
+        
+        friend DspTerm operator+(DspTerm const& a, DspTerm const& b);
+        friend DspTerm operator-(DspTerm const& a, DspTerm const& b);
+        friend DspTerm operator*(DspTerm const& a, DspTerm const& b);
+        friend DspTerm operator/(DspTerm const& a, DspTerm const& b);
+        friend DspTerm operator-(DspTerm const& a);
+    };
+    
+    DspTerm operator+(DspTerm const& a, DspTerm const& b);
+    DspTerm operator-(DspTerm const& a, DspTerm const& b);
+    DspTerm operator*(DspTerm const& a, DspTerm const& b);
+    DspTerm operator/(DspTerm const& a, DspTerm const& b);
+    DspTerm operator-(DspTerm const& a);
+    ostream& operator<<(ostream &output, const DspTerm &term);
+    
     // ================================================================================ //
     //                                      DSP MATH                                    //
     // ================================================================================ //
     
     //! The math class is used to represent the mathematical operation of digital signal processing.
     /**
-     The math class is used to represent the mathematical operation of digital signal processing.
+     The math class is used to represent the mathematical operation of digital signal processing. The equation of a process is parsed into a term, simplified and compiled into a kernel, so an elementwise process can be described by its equation and evaluated by the vectorized interpreter.
      */
     class DspExpr
     {
         
     private:
-        const string    m_name;
-        string          m_equation;
-        vector<DspExpr> m_exprs;
-        
-        vector<double>  m_constantes;
+        const string                m_name;
+        string                      m_equation;
+        vector<DspExpr>             m_exprs;
+        DspTerm                     m_term;
+        map<char, const sample*>    m_variables;
+        bool                        m_pure;
+        bool                        m_sink;
+        shared_ptr<const DspKernel> m_kernel;
     public:
         
         //! Constructor.
         /**
          */
         DspExpr(const string& name) noexcept :
-        m_name(name)
+        m_name(name),
+        m_pure(false),
+        m_sink(false)
         {
             ;
         }
         
         //! Constructor.
-        /**
+        /** The function parses the equation, the term is empty if the equation isn't valid.
          */
         DspExpr(const string& name, const string& equation) noexcept :
         m_name(name),
-        m_equation(equation)
+        m_pure(false),
+        m_sink(false)
         {
-            ;
+            setEquation(equation);
         }
         
         //! Destructor.
@@ -79,21 +228,130 @@ namespace Kiwi
             m_exprs.push_back(expr);
         }
         
-        void setEquation(const string& equation)
+        //! Set the equation.
+        /** The method parses and simplifies the equation, the equation is kept for the printing even if it isn't valid.
+         @param equation The equation.
+         @return True if the equation is valid otherwise false.
+         */
+        bool setEquation(const string& equation) noexcept;
+        
+        //! Set the term.
+        /** The method simplifies the term and uses it as the equation.
+         @param term The term.
+         */
+        void setTerm(DspTerm const& term) noexcept;
+        
+        //! Retrieve the term.
+        /** The method retrieves the simplified term of the equation.
+         @return The term, it's empty if the equation isn't valid.
+         */
+        inline DspTerm getTerm() const noexcept
+        {
+            return m_term;
+        }
+        
+        //! Retrieve the equation.
+        /** The method retrieves the equation.
+         @return The equation.
+         */
+        inline string getEquation() const noexcept
+        {
+            return m_equation;
+        }
+        
+        //! Retrieve the name.
+        /** The method retrieves the name of the expression.
+         @return The name.
+         */
+        inline string getName() const noexcept
+        {
+            return m_name;
+        }
+        
+        //! Bind a variable.
+        /** The method binds a named variable of the equation to an address, the variable is read at each chunk so it can change between two blocks. The variable must stay valid as long as the kernel.
+         @param name  The name of the variable.
+         @param value The address of the variable.
+         */
+        void addVariable(const char name, const sample* value) noexcept;
+        
+        //! Set if the process is pure.
+        /** A pure process has outputs that only depend on the current samples of its inputs, it has no state and doesn't receive events. The chain evaluates once the pure nodes that are only fed by constants.
+         @param status The pure status.
+         */
+        void setPure(const bool status) noexcept
+        {
+            m_pure = status;
+        }
+        
+        //! Check if the process is pure.
+        /** The method checks if the process is pure.
+         @return True if the process is pure otherwise false.
+         */
+        bool isPure() const noexcept
+        {
+            return m_pure;
+        }
+        
+        //! Set the kernel of the process.
+        /** An elementwise process with one output can describe its perform method with a kernel, the chain can then merge a run of elementwise nodes into one loop. The kernel must compute exactly what the perform method computes and its inputs are the inputs of the node. The kernel overrides the one compiled from the equation, only the processes that set their kernel are fused, an equation alone is a description.
+         @param kernel The kernel.
+         */
+        void setKernel(DspKernel const& kernel)
+        {
+            m_kernel = make_shared<const DspKernel>(kernel);
+        }
+        
+        //! Check if the process has set its kernel.
+        /** The method checks if the process describes its perform method with a kernel, only these processes can be fused by the chain.
+         @return True if the kernel has been set otherwise false.
+         */
+        inline bool hasKernel() const noexcept
+        {
+            return bool(m_kernel);
+        }
+        
+        //! Check if the variables of the equation are bound.
+        /** The method checks if the equation is valid and if all its variables have an address.
+         @return True if the equation can be evaluated otherwise false.
+         */
+        inline bool isBound() const noexcept
         {
-            m_equation = equation;
+            return m_term.isValid() && m_term.isBound(m_variables);
         }
         
-        void addVariable(const char name);
+        //! Retrieve the kernel of the process.
+        /** The method retrieves the kernel set by the process or the kernel compiled from the equation.
+         @return The kernel or nullptr if the process isn't elementwise or if a variable of the equation isn't bound.
+         */
+        shared_ptr<const DspKernel> getKernel() const;
+        
+        //! Compile the equation.
+        /** The method compiles the equation into a kernel, a process can use it to evaluate its equation in its perform method.
+         @param kernel The kernel.
+         @return True if the equation is valid and all its variables are bound otherwise false.
+         */
+        bool compile(DspKernel& kernel) const;
+        
+        //! Set if the process is a sink.
+        /** A sink has effects outside of the chain, such as writing the outputs of the device, so it's never removed by the chain. The nodes without output are always sinks.
+         @param status The sink status.
+         */
+        void setSink(const bool status) noexcept
+        {
+            m_sink = status;
+        }
         
-        void post() const noexcept
+        //! Check if the process is a sink.
+        /** The method checks if the process is a sink.
+         @return True if the process is a sink otherwise false.
+         */
+        bool isSink() const noexcept
         {
-            for(vector<DspExpr>::size_type i = 0; i < m_exprs.size(); i++)
-            {
-                m_exprs[i].post();
-            }
-            cout << "y_" + m_name + "(t) = " + m_equation << endl;
+            return m_sink;
         }
+        
+        void post() const noexcept;
     };
     
     ostream& operator<<(ostream &output, const DspExpr &expr);
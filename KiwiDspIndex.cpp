@@ -0,0 +1,174 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+
+#include "KiwiDspIndex.h"
+#include "KiwiDspNode.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP INDEX                                   //
+    // ================================================================================ //
+    
+    DspIndex::DspIndex() noexcept
+    {
+        ;
+    }
+    
+    void DspIndex::clear() noexcept
+    {
+        m_nodes.clear();
+        m_inputs.clear();
+        m_outputs.clear();
+        m_sources_offsets.clear();
+        m_readers_offsets.clear();
+        m_sources.clear();
+        m_readers.clear();
+    }
+    
+    void DspIndex::build(vector<sDspNode> const& nodes, vector<sDspLink> const& links)
+    {
+        clear();
+        ulong ninputs = 0ul, noutputs = 0ul;
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+        {
+            nodes[i]->m_row = (ulong)i;
+            m_nodes.push_back(nodes[i].get());
+            m_inputs.push_back(ninputs);
+            m_outputs.push_back(noutputs);
+            ninputs  += nodes[i]->getNumberOfInputs();
+            noutputs += nodes[i]->getNumberOfOutputs();
+        }
+        m_inputs.push_back(ninputs);
+        m_outputs.push_back(noutputs);
+        
+        // The links are sorted by input then by output so the duplicates are adjacent.
+        struct Link
+        {
+            ulong   input;
+            ulong   output;
+            ulong   to;
+            ulong   from;
+            bool    feedback;
+            
+            bool operator<(Link const& other) const noexcept
+            {
+                return input != other.input ? input < other.input : output < other.output;
+            }
+            
+            bool operator==(Link const& other) const noexcept
+            {
+                return input == other.input && output == other.output;
+            }
+        };
+        vector<Link> edges;
+        for(vector<sDspLink>::size_type i = 0; i < links.size(); i++)
+        {
+            sDspNode from = links[i]->getOutpuNode(), to = links[i]->getInputNode();
+            if(contains(from.get()) && contains(to.get()) && (from != to || links[i]->isFeedback()) &&
+               links[i]->getOutputIndex() < from->getNumberOfOutputs() && links[i]->getInputIndex() < to->getNumberOfInputs())
+            {
+                edges.push_back({m_inputs[to->m_row] + links[i]->getInputIndex(), m_outputs[from->m_row] + links[i]->getOutputIndex(), to->m_row, from->m_row, links[i]->isFeedback()});
+            }
+        }
+        sort(edges.begin(), edges.end());
+        edges.erase(unique(edges.begin(), edges.end()), edges.end());
+        
+        m_sources_offsets.assign(ninputs + 1ul, 0ul);
+        m_readers_offsets.assign(noutputs + 1ul, 0ul);
+        for(vector<Link>::size_type i = 0; i < edges.size(); i++)
+        {
+            m_sources_offsets[edges[i].input + 1ul]++;
+            m_readers_offsets[edges[i].output + 1ul]++;
+        }
+        for(ulong i = 0; i < ninputs; i++)
+        {
+            m_sources_offsets[i + 1ul] += m_sources_offsets[i];
+        }
+        for(ulong i = 0; i < noutputs; i++)
+        {
+            m_readers_offsets[i + 1ul] += m_readers_offsets[i];
+        }
+        
+        m_sources.resize(edges.size());
+        m_readers.resize(edges.size());
+        vector<ulong> sources(m_sources_offsets.begin(), m_sources_offsets.end() - 1);
+        vector<ulong> readers(m_readers_offsets.begin(), m_readers_offsets.end() - 1);
+        for(vector<Link>::size_type i = 0; i < edges.size(); i++)
+        {
+            Link const& link = edges[i];
+            m_sources[sources[link.input]++] = {nodes[link.from].get(), link.output - m_outputs[link.from], link.feedback};
+            m_readers[readers[link.output]++] = {nodes[link.to].get(), link.input - m_inputs[link.to], link.feedback};
+        }
+        
+        // The ports count their links so the nodes can check them without the index, the audio thread can read the counts.
+        for(vector<sDspNode>::size_type i = 0; i < nodes.size(); i++)
+        {
+            for(ulong j = 0; j < nodes[i]->getNumberOfInputs(); j++)
+            {
+                const Range range = getSources(nodes[i].get(), j);
+                nodes[i]->getCompiledInput(j)->m_nlinks.store(range.size(), memory_order_relaxed);
+                nodes[i]->getCompiledInput(j)->m_nfeedbacks.store(count(range), memory_order_relaxed);
+            }
+            for(ulong j = 0; j < nodes[i]->getNumberOfOutputs(); j++)
+            {
+                const Range range = getReaders(nodes[i].get(), j);
+                nodes[i]->getCompiledOutput(j)->m_nlinks.store(range.size(), memory_order_relaxed);
+                nodes[i]->getCompiledOutput(j)->m_nfeedbacks.store(count(range), memory_order_relaxed);
+            }
+        }
+    }
+    
+    bool DspIndex::contains(const DspNode* node) const noexcept
+    {
+        // The row of a node that left the index can be used by another node.
+        return node && node->m_row < (ulong)m_nodes.size() && m_nodes[node->m_row] == node;
+    }
+    
+    ulong DspIndex::count(Range const& range) noexcept
+    {
+        ulong nfeedbacks = 0ul;
+        for(auto it = range.begin(); it != range.end(); ++it)
+        {
+            if(it->feedback)
+            {
+                nfeedbacks++;
+            }
+        }
+        return nfeedbacks;
+    }
+    
+    DspIndex::Range DspIndex::range(vector<ulong> const& ports, vector<ulong> const& offsets, vector<Edge> const& edges, const DspNode* node, const ulong index) const noexcept
+    {
+        if(contains(node) && ports[node->m_row] + index < ports[node->m_row + 1ul])
+        {
+            const ulong port = ports[node->m_row] + index;
+            return {edges.data() + offsets[port], edges.data() + offsets[port + 1ul]};
+        }
+        return {nullptr, nullptr};
+    }
+}
+
+
+
@@ -0,0 +1,120 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+
+#ifndef __DEF_KIWI_DSP_INDEX__
+#define __DEF_KIWI_DSP_INDEX__
+
+#include "KiwiDspSignal.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP INDEX                                   //
+    // ================================================================================ //
+    
+    //! The dsp index is a compiled adjacency of the links of a chain.
+    /**
+     The dsp index stores the links in compressed sparse rows, the edges of a port are contiguous so the inputs and the scheduler traverse them without lookup in a tree. Each node keeps its row in the index, so the edges of a port are found with two array reads. Each edge knows the exact port on the other side, so a node linked to several ports of another node is not ambiguous. The index is the only record of the links of the nodes, it's rebuilt from the links when the chain is compiled or edited and it counts the links of each port.
+     */
+    class DspIndex
+    {
+    public:
+        //! An edge of a port.
+        struct Edge
+        {
+            DspNode*    node;       ///< The node on the other side.
+            ulong       port;       ///< The port on the other side.
+            bool        feedback;   ///< If the link is a feedback link.
+        };
+        
+        //! The edges of a port.
+        struct Range
+        {
+            const Edge* first;
+            const Edge* last;
+            
+            inline const Edge* begin() const noexcept {return first;}
+            inline const Edge* end() const noexcept {return last;}
+            inline ulong size() const noexcept {return ulong(last - first);}
+            inline bool empty() const noexcept {return first == last;}
+        };
+    private:
+        vector<const DspNode*> m_nodes;
+        vector<ulong>   m_inputs;
+        vector<ulong>   m_outputs;
+        vector<ulong>   m_sources_offsets;
+        vector<ulong>   m_readers_offsets;
+        vector<Edge>    m_sources;
+        vector<Edge>    m_readers;
+        
+        Range range(vector<ulong> const& ports, vector<ulong> const& offsets, vector<Edge> const& edges, const DspNode* node, const ulong index) const noexcept;
+        static ulong count(Range const& range) noexcept;
+        bool contains(const DspNode* node) const noexcept;
+    public:
+        
+        //! Constructor.
+        /** The function initializes an empty index.
+         */
+        DspIndex() noexcept;
+        
+        //! Build the index.
+        /** The function builds the edges of the ports of the nodes from the links, the links between nodes that aren't in the list and the duplicated links are ignored. The rows of the nodes and the numbers of links of their ports are updated.
+         @param nodes The nodes.
+         @param links The links.
+         */
+        void build(vector<sDspNode> const& nodes, vector<sDspLink> const& links);
+        
+        //! Clear the index.
+        /** The function removes all the edges.
+         */
+        void clear() noexcept;
+        
+        //! Retrieve the sources of an input.
+        /** The function retrieves the outputs that are linked to an input of a node.
+         @param node    The node.
+         @param index   The index of the input.
+         @return The edges, the ports are the indices of the outputs.
+         */
+        inline Range getSources(const DspNode* node, const ulong index) const noexcept
+        {
+            return range(m_inputs, m_sources_offsets, m_sources, node, index);
+        }
+        
+        //! Retrieve the readers of an output.
+        /** The function retrieves the inputs that are linked to an output of a node.
+         @param node    The node.
+         @param index   The index of the output.
+         @return The edges, the ports are the indices of the inputs.
+         */
+        inline Range getReaders(const DspNode* node, const ulong index) const noexcept
+        {
+            return range(m_outputs, m_readers_offsets, m_readers, node, index);
+        }
+    };
+}
+
+
+#endif
+
+
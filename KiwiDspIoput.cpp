@@ -34,56 +34,87 @@ namespace Kiwi
     
     DspOutput::DspOutput(const ulong index) noexcept :
     m_index(index),
+    m_nchannels(1ul),
+    m_size(0ul),
     m_vector(nullptr),
-    m_owner(false)
+    m_owner(false),
+    m_mode(DspVector),
+    m_value(0.),
+    m_touched(false),
+    m_cache(false),
+    m_reserved(false),
+    m_delay(0ul),
+    m_history(nullptr),
+    m_position(0ul),
+    m_swapped(false),
+    m_last(nullptr),
+    m_sample(nullptr),
+    m_nlinks(0ul),
+    m_nfeedbacks(0ul)
     {
         
     }
     
     DspOutput::~DspOutput()
     {
-        if(m_owner && m_vector)
-        {
-            delete [] m_vector;
-        }
-        m_links.clear();
-    }
-    
-    void DspOutput::add(sDspNode node)
-    {
-        m_links.insert(node);
+        
     }
     
-    void DspOutput::remove(sDspNode node)
+    void DspOutput::clear()
     {
-        m_links.erase(node);
+        m_nlinks.store(0ul, memory_order_relaxed);
+        m_nfeedbacks.store(0ul, memory_order_relaxed);
+        m_vector    = nullptr;
+        m_owner     = false;
+        m_reserved  = false;
+        m_delay     = 0ul;
+        m_history   = nullptr;
+        m_position  = 0ul;
+        m_swapped   = false;
+        m_last      = nullptr;
+        m_sample    = nullptr;
     }
     
-    void DspOutput::clear()
+    void DspOutput::reserve(sDspNode node, DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&)
     {
-        m_links.clear();
-        if(m_owner && m_vector)
+        m_reserved = false;
+        try
         {
-            delete [] m_vector;
-            m_vector = nullptr;
+            start(node, arena, index, vectorsize);
         }
-        m_owner     = false;
+        catch(DspError& e)
+        {
+            throw e;
+        }
+        m_reserved = true;
     }
     
-    void DspOutput::start(sDspNode node) throw(DspError&)
+    void DspOutput::start(sDspNode node, DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&)
     {
-        if(m_owner && m_vector)
+        if(m_reserved)
         {
-            delete [] m_vector;
-            m_vector = nullptr;
+            m_reserved = false;
+            return;
         }
+        m_vector    = nullptr;
         m_owner     = false;
+        m_mode      = DspVector;
+        m_value     = 0.;
+        m_touched   = false;
+        m_cache     = false;
+        m_history   = nullptr;
+        m_position  = 0ul;
+        m_swapped   = false;
+        m_last      = nullptr;
+        m_sample    = nullptr;
         
         if(node)
         {
-            if(node->isInplace() && node->getNumberOfInputs() > m_index)
+            m_size = vectorsize * m_nchannels;
+            // An output read by a feedback link must keep its vector until the next block.
+            if(node->isInplace() && !m_nfeedbacks && node->getNumberOfInputs() > m_index && !node->getCompiledInput(m_index)->empty() && node->getCompiledInput(m_index)->getNumberOfChannels() == m_nchannels)
             {
-                m_vector = node->m_inputs[m_index]->getVector();
+                m_vector = node->getCompiledInput(m_index)->getVector();
                 if(!m_vector)
                 {
                     throw DspError(node, DspError::Inplace);
@@ -92,15 +123,40 @@ namespace Kiwi
             if(!m_vector)
             {
                 m_owner     = true;
-                try
+                m_cache     = true;
+                m_vector    = arena.allocateSamples(m_size);
+                if(!m_vector)
                 {
-                    m_vector    = new sample[node->getVectorSize()];
+                    throw DspError(node, DspError::Alloc);
                 }
-                catch(bad_alloc& e)
+            }
+            if(m_delay)
+            {
+                m_history = arena.allocateSamples((m_delay + vectorsize) * m_nchannels);
+                if(!m_history)
+                {
+                    throw DspError(node, DspError::Alloc);
+                }
+            }
+            
+            // A reader that runs after the node with a feedback link needs the previous block while the node writes the current one.
+            const DspIndex::Range readers = index.getReaders(node.get(), m_index);
+            bool swapped = false;
+            for(auto it = readers.begin(); it != readers.end() && !node->m_constant; ++it)
+            {
+                swapped = swapped || (it->feedback && it->node->index > node->index);
+            }
+            if(swapped)
+            {
+                // The constant of the previous block is in the other vector so it can't be cached.
+                m_swapped   = true;
+                m_cache     = false;
+                m_sample    = node->getCompiledSampleOutputs() + m_index;
+                m_last      = arena.allocateSamples(m_size);
+                if(!m_last)
                 {
                     throw DspError(node, DspError::Alloc);
                 }
-                Signal::vclear(node->getVectorSize(), m_vector);
             }
         }
     }
@@ -111,120 +167,207 @@ namespace Kiwi
     
     DspInput::DspInput(const ulong index) noexcept :
     m_index(index),
+    m_nchannels(1ul),
+    m_size(0ul),
     m_vector(nullptr),
+    m_owner(false),
+    m_mode(DspScalar),
+    m_value(0.),
+    m_cache(false),
     m_nothers(0ul),
-    m_others(nullptr)
+    m_others(nullptr),
+    m_sources(nullptr),
+    m_source(nullptr),
+    m_ndelays(0ul),
+    m_nfollows(0ul),
+    m_pointers(nullptr),
+    m_follows(nullptr),
+    m_ntaps(0ul),
+    m_taps(nullptr),
+    m_lags(nullptr),
+    m_nlinks(0ul),
+    m_nfeedbacks(0ul)
     {
         
     }
     
     DspInput::~DspInput()
     {
-        if(m_nothers && m_others)
-        {
-            delete [] m_others;
-            m_others = nullptr;
-        }
-        if(m_vector)
-        {
-            delete [] m_vector;
-            m_vector = nullptr;
-        }
-        m_links.clear();
-    }
-    
-    void DspInput::add(sDspNode node)
-    {
-        m_links.insert(node);
+        
     }
     
-    void DspInput::remove(sDspNode node)
+    void DspInput::clear()
     {
-        m_links.erase(node);
+        m_nlinks.store(0ul, memory_order_relaxed);
+        m_nfeedbacks.store(0ul, memory_order_relaxed);
+        m_vector    = nullptr;
+        m_owner     = false;
+        m_mode      = DspScalar;
+        m_value     = 0.;
+        m_cache     = false;
+        m_others    = nullptr;
+        m_sources   = nullptr;
+        m_source    = nullptr;
+        m_nothers   = 0ul;
+        m_ndelays   = 0ul;
+        m_nfollows  = 0ul;
+        m_pointers  = nullptr;
+        m_follows   = nullptr;
+        m_ntaps     = 0ul;
+        m_taps      = nullptr;
+        m_lags      = nullptr;
     }
     
-    void DspInput::clear()
+    ulong DspInput::compensation(const DspNode* node, const DspNode* source, const bool feedback) noexcept
     {
-        m_links.clear();
-        if(m_vector)
+        if(feedback || source->m_constant || source->m_dead)
         {
-            delete [] m_vector;
-            m_vector = nullptr;
+            return 0ul;
         }
-        if(m_nothers && m_others)
-        {
-            delete [] m_others;
-            m_others = nullptr;
-        }
-        m_nothers   = 0ul;
+        const ulong arrival = source->m_arrival + source->m_latency;
+        return node->m_arrival > arrival ? node->m_arrival - arrival : 0ul;
     }
     
-    void DspInput::start(sDspNode node) throw(DspError&)
+    void DspInput::start(sDspNode node, DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&)
     {
-        if(m_vector)
-        {
-            delete [] m_vector;
-            m_vector = nullptr;
-        }
-        if(m_nothers && m_others)
-        {
-            delete [] m_others;
-            m_others = nullptr;
-        }
+        m_vector    = nullptr;
+        m_owner     = false;
+        m_mode      = DspScalar;
+        m_value     = 0.;
+        m_cache     = false;
+        m_others    = nullptr;
+        m_sources   = nullptr;
+        m_source    = nullptr;
         m_nothers   = 0;
+        m_ndelays   = 0;
+        m_nfollows  = 0;
+        m_pointers  = nullptr;
+        m_follows   = nullptr;
+        m_ntaps     = 0;
+        m_taps      = nullptr;
+        m_lags      = nullptr;
         
         if(node)
         {
-            m_size = node->getVectorSize();
-            for(auto it = m_links.begin(); it != m_links.end(); )
+            m_size = vectorsize * m_nchannels;
+            const DspIndex::Range sources = index.getSources(node.get(), m_index);
+            ulong ntaps = 0ul, nswapped = 0ul;
+            for(auto it = sources.begin(); it != sources.end(); ++it)
             {
-                sDspNode in = (*it).lock();
-                if(in)
+                ntaps += compensation(node.get(), it->node, it->feedback) ? 1ul : 0ul;
+                nswapped += it->node->getCompiledOutput(it->port)->isSwapped() ? 1ul : 0ul;
+            }
+            m_others  = (sample **)arena.allocate(sources.size() * sizeof(sample *));
+            m_sources = (DspOutput **)arena.allocate(sources.size() * sizeof(DspOutput *));
+            if(!m_others || !m_sources)
+            {
+                throw DspError(node, DspError::Alloc);
+            }
+            if(ntaps)
+            {
+                m_taps  = (DspOutput **)arena.allocate(ntaps * sizeof(DspOutput *));
+                m_lags  = (ulong *)arena.allocate(ntaps * sizeof(ulong));
+                if(!m_taps || !m_lags)
                 {
-                    ++it;
+                    throw DspError(node, DspError::Alloc);
                 }
-                else
+            }
+            if(nswapped)
+            {
+                // A single source read directly is followed by the vector of the input and by the vector of the node.
+                m_pointers = (sample ***)arena.allocate((nswapped + 1ul) * sizeof(sample **));
+                m_follows  = (sample* const**)arena.allocate((nswapped + 1ul) * sizeof(sample **));
+                if(!m_pointers || !m_follows)
                 {
-                    it = m_links.erase(it);
+                    throw DspError(node, DspError::Alloc);
                 }
             }
-            
-            m_others  = new sample*[m_links.size()];
-            ulong inc = 0;
-            for(auto it = m_links.begin(); it != m_links.end(); ++it)
+            ulong inc   = 0;
+            bool shared = false;
+            for(auto it = sources.begin(); it != sources.end(); ++it)
             {
-                sDspNode in = (*it).lock();
-                if(in)
+                DspNode* in = it->node;
+                DspOutput* output = in->getCompiledOutput(it->port);
+                if(output->getNumberOfChannels() != m_nchannels)
                 {
-                    sDspOutput output = nullptr;
-                    for(vector<DspNodeSet>::size_type i = 0; i < in->m_outputs.size(); i++)
-                    {
-                        if(in->m_outputs[i]->hasNode(node))
-                        {
-                            output = in->m_outputs[i];
-                            break;
-                        }
-                    }
-                    if(output)
+                    throw DspError(node, DspError::Channels);
+                }
+                else if(it->feedback && in->index < node->index && output->isSwapped())
+                {
+                    // The source runs before the node so the previous block is read from the other vector of the output.
+                    m_ndelays++;
+                    m_pointers[m_nfollows]  = m_others + inc;
+                    m_follows[m_nfollows++] = &output->m_last;
+                    m_sources[inc]  = output;
+                    m_others[inc++] = nullptr;
+                    shared = true;
+                }
+                else if(compensation(node.get(), it->node, it->feedback))
+                {
+                    // The source is on a shorter path, it's read from its history.
+                    m_lags[m_ntaps]     = compensation(node.get(), it->node, it->feedback);
+                    m_taps[m_ntaps++]   = output;
+                }
+                else
+                {
+                    // The source of a feedback link runs after the node so its vector still holds the previous block.
+                    m_sources[inc]  = output;
+                    m_others[inc]   = nullptr;
+                    if(output->isSwapped())
                     {
-                        m_others[inc++] = output->getVector();
+                        // The vector is only read at each block because the source can be swapping it while the node is restarted.
+                        m_pointers[m_nfollows]  = m_others + inc;
+                        m_follows[m_nfollows++] = &output->m_vector;
                     }
                     else
                     {
-                        throw DspError(node, DspError::Recopy);
+                        m_others[inc] = output->getVector();
                     }
+                    inc++;
+                    shared = index.getReaders(in, it->port).size() > 1 || it->feedback || in->m_constant;
                 }
             }
-            try
+            
+            // A single source is read directly unless the node writes in place over a buffer that other nodes read.
+            const bool writes = node->isInplace() && node->getNumberOfOutputs() > m_index;
+            if(inc == 1 && !m_ntaps && !(writes && shared))
             {
-                m_vector    = new sample[node->getVectorSize()];
+                m_vector    = m_others[0];
+                m_owner     = false;
+                if(m_ndelays)
+                {
+                    // The previous block of the source is read as a signal, its mode is the one of the current block.
+                    m_mode      = DspVector;
+                    m_source    = nullptr;
+                }
+                else
+                {
+                    m_source    = m_sources[0];
+                }
+                if(m_nfollows)
+                {
+                    m_pointers[0] = &m_vector;
+                    m_pointers[1] = node->getCompiledSampleInputs() + m_index;
+                    m_follows[1]  = m_follows[0];
+                    m_nfollows    = 2ul;
+                }
+                if(writes)
+                {
+                    // The source can be running in the current plan while the node is restarted.
+                    m_sources[0]->m_cache.store(false, memory_order_relaxed);
+                }
             }
-            catch(bad_alloc& e)
+            else
             {
-                throw DspError(node, DspError::Alloc);
+                m_vector    = arena.allocateSamples(m_size);
+                if(!m_vector)
+                {
+                    throw DspError(node, DspError::Alloc);
+                }
+                m_owner     = true;
+                m_cache     = !writes;
+                m_nothers   = inc;
             }
-            Signal::vclear(node->getVectorSize(), m_vector);
-            m_nothers = m_links.size();
         }
     }
     
@@ -232,12 +375,13 @@ namespace Kiwi
     //                                      DSP LINK                                    //
     // ================================================================================ //
     
-    DspLink::DspLink(const sDspChain chain, const sDspNode from, const ulong output, const sDspNode to, const ulong input) noexcept :
+    DspLink::DspLink(const sDspChain chain, const sDspNode from, const ulong output, const sDspNode to, const ulong input, const bool feedback) noexcept :
     m_chain(chain),
     m_from(from),
     m_output(output),
     m_to(to),
-    m_input(input)
+    m_input(input),
+    m_feedback(feedback)
     {
         ;
     }
@@ -252,7 +396,7 @@ namespace Kiwi
         sDspChain chain = getChain();
         sDspNode  from  = getOutpuNode();
         sDspNode  to    = getInputNode();
-        if(chain && from && to && from != to)
+        if(chain && from && to && (from != to || m_feedback))
         {
             return getOutputIndex() < from->getNumberOfOutputs() && getInputIndex() < to->getNumberOfInputs();
         }
@@ -261,18 +405,6 @@ namespace Kiwi
             return false;
         }
     }
-    
-    void DspLink::start() const noexcept
-    {
-        sDspChain chain = getChain();
-        sDspNode  from  = getOutpuNode();
-        sDspNode  to    = getInputNode();
-        if(chain && from && to && from != to)
-        {
-            from->addOutput(to, getOutputIndex());
-            to->addInput(from, getInputIndex());
-        }
-    }
 }
 
 
@@ -24,7 +24,7 @@
 #ifndef __DEF_KIWI_DSP_IOPUT__
 #define __DEF_KIWI_DSP_IOPUT__
 
-#include "KiwiDspError.h"
+#include "KiwiDspArena.h"
 
 namespace Kiwi
 {
@@ -34,16 +34,33 @@ namespace Kiwi
     
     //! The ouput manages the sample vectors of one ouput of a node.
     /**
-     The ouput owns a vector of sample and manages the ownership and sharing of the vector between several dsp nodes.
+     The ouput owns a vector of sample and manages the ownership and sharing of the vector between several dsp nodes. An output can carry several channels in one planar vector.
      */
     class DspOutput
     {
     private:
         friend DspChain;
+        friend DspPlan;
+        friend DspInput;
+        friend DspIndex;
         const ulong   m_index;
+        ulong         m_nchannels;
+        ulong         m_size;
         sample*       m_vector;
         bool          m_owner;
-        DspNodeSet    m_links;
+        DspMode       m_mode;
+        sample        m_value;
+        bool          m_touched;
+        atomic_bool   m_cache;
+        bool          m_reserved;
+        ulong         m_delay;
+        sample*       m_history;
+        ulong         m_position;
+        bool          m_swapped;
+        sample*       m_last;
+        sample**      m_sample;
+        atomic<ulong> m_nlinks;
+        atomic<ulong> m_nfeedbacks;
         
     public:
         //! Constructor.
@@ -56,36 +73,36 @@ namespace Kiwi
          */
         ~DspOutput();
         
-        //! Add a node to the output.
-        /** This function adds a node to the output.
-         @param The node to add.
-         */
-        void add(sDspNode node);
-        
-        //! Remove a node from the output.
-        /** This function removes a node from the output.
-         @param The node to remove.
-         */
-        void remove(sDspNode node);
-        
-        //! Remove all the nodes from the output.
-        /** This function removes all the nodes from the output.
+        //! Clear the output.
+        /** This function releases the vector of the output and forgets its links until the index of the chain is rebuilt.
          */
         void clear();
         
         //! Prepare the output.
-        /** This function prepare the output.
-         @param The owner node.
+        /** This function prepare the output. If a node that runs after the owner reads the output with a feedback link, the output keeps two vectors and swaps them at each block, so the reader gets the previous block without a copy. Without owner node, the output only forgets its vectors.
+         @param node        The owner node.
+         @param arena       The arena of the chain.
+         @param index       The index of the links of the chain.
+         @param vectorsize  The vector size of the chain.
+         */
+        void start(sDspNode node, DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&);
+        
+        //! Prepare the output before the other nodes.
+        /** This function prepares the output before the nodes that read it with a feedback link, the next call to start does nothing.
+         @param node        The owner node.
+         @param arena       The arena of the chain.
+         @param index       The index of the links of the chain.
+         @param vectorsize  The vector size of the chain.
          */
-        void start(sDspNode node) throw(DspError&);
+        void reserve(sDspNode node, DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&);
         
         //! Retrieve if the links are empty.
-        /** This function retrieves if the links are empty.
+        /** This function retrieves if the links are empty. The links are counted when the index of the chain is rebuilt, the count can be read by the audio thread while a plan that doesn't have the links yet is performed.
          @param true if if the links are empty, otherwise false.
          */
         inline bool empty() const noexcept
         {
-            return m_links.empty();
+            return !m_nlinks.load(memory_order_relaxed);
         }
         
         //! Retrieve the number of links.
@@ -94,16 +111,7 @@ namespace Kiwi
          */
         inline ulong size() const noexcept
         {
-            return (ulong)m_links.size();
-        }
-        
-        //! Retrieve if the output has a node.
-        /** This function retrieves if the output has a node.
-         @param true if the output has a node, otherwise false.
-         */
-        inline bool hasNode(sDspNode node) const
-        {
-            return m_links.find(node) != m_links.end();
+            return m_nlinks.load(memory_order_relaxed);
         }
         
         //! Check if the output is the owner of the vector.
@@ -115,6 +123,24 @@ namespace Kiwi
             return m_owner;
         }
         
+        //! Retrieve the number of channels.
+        /** This function retrieves the number of channels of the output. The channels are planar, the vector holds the channels one after the other.
+         @return The number of channels.
+         */
+        inline ulong getNumberOfChannels() const noexcept
+        {
+            return m_nchannels;
+        }
+        
+        //! Set the number of channels.
+        /** This function sets the number of channels of the output, it will be used at the next compilation.
+         @param nchannels The number of channels.
+         */
+        inline void setNumberOfChannels(const ulong nchannels) noexcept
+        {
+            m_nchannels = nchannels ? nchannels : 1ul;
+        }
+        
         //! Retrieve the vector of the output.
         /** This function retrieves the vector of the output.
          @return The vector of the output.
@@ -123,6 +149,109 @@ namespace Kiwi
         {
             return m_vector;
         }
+        
+        //! Check if the output swaps its vectors.
+        /** This function checks if the output keeps the vector of the previous block for a feedback link. The readers of such an output follow its vectors at each block instead of keeping a pointer.
+         @return true if the output swaps its vectors, otherwise false.
+         */
+        inline bool isSwapped() const noexcept
+        {
+            return m_swapped;
+        }
+        
+        //! Swap the vectors of the output.
+        /** This function must be called before the owner performs a block when the output swaps its vectors. The vector that held the previous block becomes the vector of the current block.
+         */
+        inline void swap() noexcept
+        {
+            sample* vector = m_vector;
+            m_vector  = m_last;
+            m_last    = vector;
+            *m_sample = m_vector;
+        }
+        
+        //! Retrieve the mode of the output for the current block.
+        /** This function retrieves if the vector of the output is a constant (scalar) or a signal (vector) for the current block.
+         @return The mode of the output.
+         */
+        inline DspMode getMode() const noexcept
+        {
+            return m_mode;
+        }
+        
+        //! Retrieve the value of the output when it is a scalar.
+        /** This function retrieves the constant value of the output, it is only meaningful when the mode is scalar.
+         @return The value of the output.
+         */
+        inline sample getValue() const noexcept
+        {
+            return m_value;
+        }
+        
+        //! Set the output to a constant for the current block.
+        /** This function fills the vector with a constant. The vector is not refilled if it already holds the same constant and no other node writes in it.
+         @param value The constant value.
+         */
+        inline void setScalar(const sample value) noexcept
+        {
+            if(!(m_cache.load(memory_order_relaxed) && m_mode == DspScalar && m_value == value))
+            {
+                Signal::vfill(m_size, value, m_vector);
+            }
+            m_mode      = DspScalar;
+            m_value     = value;
+            m_touched   = true;
+        }
+        
+        //! Add a delayed vector of the output.
+        /** This function adds the vector of the output delayed by a number of samples to a vector, the delay can't exceed the delay reserved for the readers of the output. The history is a ring, the delayed vector can be split in two parts.
+         @param delay  The delay in samples.
+         @param vector The vector.
+         */
+        inline void addDelayed(const ulong delay, sample* vector) const noexcept
+        {
+            const ulong vectorsize = m_size / m_nchannels, length = m_delay + vectorsize;
+            ulong start = m_position + m_delay - min(delay, m_delay);
+            if(start >= length)
+            {
+                start -= length;
+            }
+            const ulong first = min(vectorsize, length - start);
+            for(ulong i = 0; i < m_nchannels; i++)
+            {
+                const sample* history = m_history + i * length;
+                Signal::vadd(first, history + start, vector + i * vectorsize);
+                Signal::vadd(vectorsize - first, history, vector + i * vectorsize + first);
+            }
+        }
+        
+        //! Close the current block.
+        /** This function switches back the output to a signal if it hasn't been set to a constant during the block. If the output is delayed for some readers, the vector is written in the ring of the history that all the readers share, the older samples don't move.
+         */
+        inline void update() noexcept
+        {
+            if(!m_touched)
+            {
+                m_mode = DspVector;
+            }
+            m_touched = false;
+            if(m_history)
+            {
+                const ulong vectorsize = m_size / m_nchannels, length = m_delay + vectorsize;
+                const ulong first = min(vectorsize, length - m_position);
+                for(ulong i = 0; i < m_nchannels; i++)
+                {
+                    sample* history = m_history + i * length;
+                    Signal::vcopy(first, m_vector + i * vectorsize, history + m_position);
+                    Signal::vcopy(vectorsize - first, m_vector + i * vectorsize + first, history);
+                }
+                m_position += vectorsize;
+                if(m_position >= length)
+                {
+                    m_position -= length;
+                }
+            }
+        }
     };
     
     // ================================================================================ //
@@ -131,18 +260,44 @@ namespace Kiwi
     
     //! The input manages the sample vectors of one input of a node.
     /**
-     The input owns a vector of sample and manages the ownership and sharing of the vector between several dsp nodes.
+     The input owns a vector of sample and manages the ownership and sharing of the vector between several dsp nodes. An input can carry several channels in one planar vector, the links must have the same number of channels.
      */
     class DspInput
     {
     private:
         friend DspChain;
+        friend DspPlan;
+        friend DspIndex;
         const ulong   m_index;
+        ulong         m_nchannels;
         ulong         m_size;
         sample*       m_vector;
+        bool          m_owner;
+        DspMode       m_mode;
+        sample        m_value;
+        bool          m_cache;
         ulong         m_nothers;
         sample**      m_others;
-        DspNodeSet    m_links;
+        DspOutput**   m_sources;
+        DspOutput*    m_source;
+        ulong         m_ndelays;
+        ulong         m_nfollows;
+        sample***     m_pointers;
+        sample* const** m_follows;
+        ulong         m_ntaps;
+        DspOutput**   m_taps;
+        ulong*        m_lags;
+        atomic<ulong> m_nlinks;
+        atomic<ulong> m_nfeedbacks;
+        
+        //! Retrieve the delay that compensates a link.
+        /** This function retrieves the number of samples a source must be delayed to arrive at the same time than the other sources of the node.
+         @param node     The owner node.
+         @param source   The source node.
+         @param feedback If the link is a feedback.
+         @return The delay in samples.
+         */
+        static ulong compensation(const DspNode* node, const DspNode* source, const bool feedback) noexcept;
     public:
         
         //! Constructor.
@@ -155,35 +310,27 @@ namespace Kiwi
          */
         ~DspInput();
         
-        //! Add a node to the input.
-        /** This function adds  a node to the input.
-         @param The node to add.
-         */
-        void add(sDspNode node);
-        
-        //! Remove a node from the input.
-        /** This function removes  a node from the input.
-         @param The node to remove.
-         */
-        void remove(sDspNode node);
-        
-        //! Remove all the nodes from the input.
-        /** This function removes all the nodes from the input.
+        //! Clear the input.
+        /** This function releases the vector of the input and forgets its links until the index of the chain is rebuilt.
          */
         void clear();
         
         //! Prepare the input.
-        /** This function prepare the input.
+        /** This function prepare the input, the sources are retrieved from the index of the chain. Without owner node, the input only forgets its vectors.
+         @param node        The owner node.
+         @param arena       The arena of the chain.
+         @param index       The index of the links of the chain.
+         @param vectorsize  The vector size of the chain.
          */
-        void start(sDspNode node) throw(DspError&);
+        void start(sDspNode node, DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&);
         
         //! Retrieve if the links are empty.
-        /** This function retrieves if the links are empty.
+        /** This function retrieves if the links are empty. The links are counted when the index of the chain is rebuilt, the count can be read by the audio thread while a plan that doesn't have the links yet is performed.
          @param true if if the links are empty, otherwise false.
          */
         inline bool empty() const noexcept
         {
-            return m_links.empty();
+            return !m_nlinks.load(memory_order_relaxed);
         }
         
         //! Retrieve the number of links.
@@ -192,7 +339,34 @@ namespace Kiwi
          */
         inline ulong size() const noexcept
         {
-            return (ulong)m_links.size();
+            return m_nlinks.load(memory_order_relaxed);
+        }
+        
+        //! Check if the input is the owner of the vector.
+        /** This function checks if the input is the owner of the vector. An input with only one link reads the vector of the output directly, unless the node writes in place over a vector shared with other nodes.
+         @return The owner status.
+         */
+        inline bool isOwner() const noexcept
+        {
+            return m_owner;
+        }
+        
+        //! Retrieve the number of channels.
+        /** This function retrieves the number of channels of the input. The channels are planar, the vector holds the channels one after the other.
+         @return The number of channels.
+         */
+        inline ulong getNumberOfChannels() const noexcept
+        {
+            return m_nchannels;
+        }
+        
+        //! Set the number of channels.
+        /** This function sets the number of channels of the input, it will be used at the next compilation.
+         @param nchannels The number of channels.
+         */
+        inline void setNumberOfChannels(const ulong nchannels) noexcept
+        {
+            m_nchannels = nchannels ? nchannels : 1ul;
         }
         
         //! Retrieve the vector of the input.
@@ -204,18 +378,82 @@ namespace Kiwi
             return m_vector;
         }
         
+        //! Retrieve the mode of the input for the current block.
+        /** This function retrieves if the vector of the input is a constant (scalar) or a signal (vector) for the current block.
+         @return The mode of the input.
+         */
+        inline DspMode getMode() const noexcept
+        {
+            return m_source ? m_source->m_mode : m_mode;
+        }
+        
+        //! Retrieve the value of the input when it is a scalar.
+        /** This function retrieves the constant value of the input, it is only meaningful when the mode is scalar.
+         @return The value of the input.
+         */
+        inline sample getValue() const noexcept
+        {
+            return m_source ? m_source->m_value : m_value;
+        }
+        
+        //! Check if the input is silent for the current block.
+        /** This function checks if the input is a constant equal to zero for the current block.
+         @return true if the input is silent, otherwise false.
+         */
+        inline bool isSilent() const noexcept
+        {
+            return getMode() == DspScalar && getValue() == 0.;
+        }
+        
         //! Perform the copy of the links to input vector.
-        /** This function perform sthe copy of the links to input vector.
+        /** This function perform sthe copy of the links to input vector. The delayed links are read from the histories of their outputs. If all the links are constants, the input only sums their values and fills its vector when the constant changes. The pointers to the outputs that swap their vectors are updated first.
          */
         inline void perform() noexcept
         {
-            if(m_nothers)
+            for(ulong i = 0; i < m_nfollows; i++)
             {
-                Signal::vcopy(m_size, m_others[0], m_vector);
+                *m_pointers[i] = *m_follows[i];
             }
-            for(ulong i = 1; i < m_nothers; i++)
+            if(m_nothers || m_ntaps)
             {
-                Signal::vadd(m_size, m_others[i], m_vector);
+                sample value = 0.;
+                bool scalar  = true;
+                for(ulong i = 0; i < m_nothers && scalar; i++)
+                {
+                    scalar = m_sources[i]->m_mode == DspScalar;
+                    value += m_sources[i]->m_value;
+                }
+                if(scalar && !m_ndelays && !m_ntaps)
+                {
+                    if(!(m_cache && m_mode == DspScalar && m_value == value))
+                    {
+                        Signal::vfill(m_size, value, m_vector);
+                    }
+                    m_mode  = DspScalar;
+                    m_value = value;
+                }
+                else
+                {
+                    if(m_nothers)
+                    {
+                        Signal::vcopy(m_size, m_others[0], m_vector);
+                    }
+                    else
+                    {
+                        Signal::vclear(m_size, m_vector);
+                    }
+                    for(ulong i = 1; i < m_nothers; i++)
+                    {
+                        Signal::vadd(m_size, m_others[i], m_vector);
+                    }
+                    
+                    // The delayed sources compensate the latency of the other paths.
+                    for(ulong i = 0; i < m_ntaps; i++)
+                    {
+                        m_taps[i]->addDelayed(m_lags[i], m_vector);
+                    }
+                    m_mode  = DspVector;
+                }
             }
         }
     };
@@ -236,12 +474,13 @@ namespace Kiwi
         const ulong     m_output;
         const wDspNode  m_to;
         const ulong     m_input;
+        const bool      m_feedback;
     public:
         
         //! Constructor.
-        /** You should never have to call this method.
+        /** You should never have to call this method. A feedback link delays the signal of one block, it is ignored when the nodes are sorted so it can close a loop.
          */
-        DspLink(const sDspChain chain, const sDspNode from, const ulong output, const sDspNode to, const ulong input) noexcept;
+        DspLink(const sDspChain chain, const sDspNode from, const ulong output, const sDspNode to, const ulong input, const bool feedback = false) noexcept;
         
         //! Destructor.
         /** You should never have to call this method.
@@ -293,16 +532,20 @@ namespace Kiwi
             return m_input;
         }
         
+        //! Retrieve if the link is a feedback link.
+        /** The function retrieves if the link delays the signal of one block.
+         @return true if the link is a feedback link, otherwise false.
+         */
+        inline bool isFeedback() const noexcept
+        {
+            return m_feedback;
+        }
+        
         //! Retrieve if the link is valid.
         /** The function retrieves if the link is valid.
          @return true if the link is valid, otherwise false.
          */
         bool isValid() const noexcept;
-        
-        //! Prepare the link to process.
-        /** This function link the node to process. It connects the output node to the input node.
-         */
-        void start() const noexcept;
     };
 }
 
@@ -0,0 +1,216 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#include "KiwiDspKernel.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP KERNEL                                  //
+    // ================================================================================ //
+
+    const ulong DspKernel::chunk;
+
+    DspKernel::DspKernel() noexcept :
+    m_ninputs(0ul),
+    m_result(0ul)
+    {
+        ;
+    }
+
+    ulong DspKernel::emit(Code code, const ulong a, const ulong b, const sample* variable)
+    {
+        const ulong index = (ulong)m_code.size();
+        m_code.push_back({code, a, b, variable});
+        m_registers.resize(m_code.size() * chunk, 0.);
+        m_pointers.resize(m_code.size(), nullptr);
+        m_result = index;
+        return index;
+    }
+
+    ulong DspKernel::input(const ulong index)
+    {
+        m_ninputs = max(m_ninputs, index + 1ul);
+        return emit(Input, index, 0ul, nullptr);
+    }
+
+    ulong DspKernel::constant(const sample value)
+    {
+        // The constants are filled once, the other instructions never write their registers.
+        const ulong index = emit(Constant, 0ul, 0ul, nullptr);
+        Signal::vfill(chunk, value, m_registers.data() + index * chunk);
+        return index;
+    }
+
+    ulong DspKernel::variable(const sample* value)
+    {
+        return emit(Variable, 0ul, 0ul, value);
+    }
+
+    ulong DspKernel::apply(Code code, const ulong a, const ulong b)
+    {
+        return emit(code, a, isBinary(code) ? b : 0ul, nullptr);
+    }
+
+    ulong DspKernel::append(DspKernel const& kernel, vector<ulong> const& inputs)
+    {
+        vector<ulong> registers(kernel.m_code.size(), 0ul);
+        for(vector<Instruction>::size_type i = 0; i < kernel.m_code.size(); i++)
+        {
+            Instruction const& ins = kernel.m_code[i];
+            if(ins.code == Input)
+            {
+                registers[i] = ins.a < inputs.size() ? inputs[ins.a] : constant(0.);
+            }
+            else if(ins.code == Constant)
+            {
+                registers[i] = constant(kernel.m_registers[i * chunk]);
+            }
+            else if(ins.code == Variable)
+            {
+                registers[i] = variable(ins.variable);
+            }
+            else
+            {
+                registers[i] = apply(ins.code, registers[ins.a], isBinary(ins.code) ? registers[ins.b] : 0ul);
+            }
+        }
+        return kernel.m_code.empty() ? constant(0.) : registers[kernel.m_result];
+    }
+
+    void DspKernel::setResult(const ulong index) noexcept
+    {
+        if(index < m_code.size())
+        {
+            m_result = index;
+        }
+    }
+
+    void DspKernel::perform(const ulong size, const sample* const* inputs, sample* output) const noexcept
+    {
+        if(m_code.empty())
+        {
+            Signal::vclear(size, output);
+            return;
+        }
+
+        const ulong ncodes = (ulong)m_code.size();
+        const Instruction* code = m_code.data();
+        sample* registers = m_registers.data();
+        const sample** pointers = m_pointers.data();
+        for(ulong offset = 0ul; offset < size; offset += chunk)
+        {
+            const ulong n = min(chunk, size - offset);
+            for(ulong k = 0ul; k < ncodes; k++)
+            {
+                sample* r = registers + k * chunk;
+                const sample* a = code[k].code > Variable ? pointers[code[k].a] : nullptr;
+                const sample* b = isBinary(code[k].code) ? pointers[code[k].b] : nullptr;
+                pointers[k] = r;
+                switch(code[k].code)
+                {
+                    case Input:
+                        pointers[k] = inputs[code[k].a] + offset;
+                        break;
+                    case Constant:
+                        break;
+                    case Variable:
+                    {
+                        const sample value = *code[k].variable;
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = value;
+                    }
+                        break;
+                    case Add:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = a[i] + b[i];
+                        break;
+                    case Sub:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = a[i] - b[i];
+                        break;
+                    case Mul:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = a[i] * b[i];
+                        break;
+                    case Div:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = a[i] / b[i];
+                        break;
+                    case Min:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = a[i] < b[i] ? a[i] : b[i];
+                        break;
+                    case Max:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = a[i] > b[i] ? a[i] : b[i];
+                        break;
+                    case Pow:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = pow(a[i], b[i]);
+                        break;
+                    case Neg:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = -a[i];
+                        break;
+                    case Abs:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = fabs(a[i]);
+                        break;
+                    case Sqrt:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = sqrt(a[i]);
+                        break;
+                    case Exp:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = exp(a[i]);
+                        break;
+                    case Log:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = log(a[i]);
+                        break;
+                    case Sin:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = sin(a[i]);
+                        break;
+                    case Cos:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = cos(a[i]);
+                        break;
+                    case Tanh:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = tanh(a[i]);
+                        break;
+                    case Floor:
+                        for(ulong i = 0; i < n; i++)
+                            r[i] = floor(a[i]);
+                        break;
+                }
+            }
+            Signal::vcopy(n, pointers[m_result], output + offset);
+        }
+    }
+}
+
+
+
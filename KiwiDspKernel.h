@@ -0,0 +1,183 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_KERNEL__
+#define __DEF_KIWI_DSP_KERNEL__
+
+#include "KiwiDspSignal.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP KERNEL                                  //
+    // ================================================================================ //
+
+    //! The dsp kernel is an elementwise program evaluated by a vectorized interpreter.
+    /**
+     The dsp kernel is a list of instructions, each instruction computes one register from the inputs, the constants, the variables or the previous registers. The interpreter evaluates the whole program on small chunks of samples so the intermediate registers stay in the cache and each instruction is a tight loop that the compiler vectorizes. The kernels of several nodes can be appended to each other to process a run of nodes in a single pass.
+     */
+    class DspKernel
+    {
+    public:
+        enum Code
+        {
+            Input    = 0,   ///< Reads an input.
+            Constant = 1,   ///< Holds a constant value.
+            Variable = 2,   ///< Reads a variable at each chunk.
+            Add      = 3,   ///< Adds two registers.
+            Sub      = 4,   ///< Subtracts two registers.
+            Mul      = 5,   ///< Multiplies two registers.
+            Div      = 6,   ///< Divides two registers.
+            Min      = 7,   ///< Retrieves the minimum of two registers.
+            Max      = 8,   ///< Retrieves the maximum of two registers.
+            Pow      = 9,   ///< Raises a register to the power of another one.
+            Neg      = 10,  ///< Negates a register.
+            Abs      = 11,  ///< Retrieves the absolute value of a register.
+            Sqrt     = 12,  ///< Retrieves the square root of a register.
+            Exp      = 13,  ///< Retrieves the exponential of a register.
+            Log      = 14,  ///< Retrieves the natural logarithm of a register.
+            Sin      = 15,  ///< Retrieves the sine of a register.
+            Cos      = 16,  ///< Retrieves the cosine of a register.
+            Tanh     = 17,  ///< Retrieves the hyperbolic tangent of a register.
+            Floor    = 18   ///< Retrieves the floor of a register.
+        };
+
+        static const ulong chunk = 16ul;
+    private:
+        struct Instruction
+        {
+            Code            code;
+            ulong           a;
+            ulong           b;
+            const sample*   variable;
+        };
+
+        vector<Instruction>             m_code;
+        ulong                           m_ninputs;
+        ulong                           m_result;
+        mutable vector<sample>          m_registers;
+        mutable vector<const sample*>   m_pointers;
+
+        ulong emit(Code code, const ulong a, const ulong b, const sample* variable);
+    public:
+
+        //! Constructor.
+        /** The function initializes an empty kernel.
+         */
+        DspKernel() noexcept;
+
+        //! Check if a code uses two registers.
+        /** The function checks if a code is a binary operation.
+         @param code The code.
+         @return True if the code uses two registers otherwise false.
+         */
+        static inline bool isBinary(Code code) noexcept
+        {
+            return code >= Add && code <= Pow;
+        }
+
+        //! Add an input.
+        /** The function adds an instruction that reads an input.
+         @param index The index of the input.
+         @return The register of the instruction.
+         */
+        ulong input(const ulong index);
+
+        //! Add a constant.
+        /** The function adds an instruction that holds a constant value.
+         @param value The value.
+         @return The register of the instruction.
+         */
+        ulong constant(const sample value);
+
+        //! Add a variable.
+        /** The function adds an instruction that reads a variable, the variable is read once per chunk so it can change between two blocks. The variable must stay valid as long as the kernel.
+         @param value The address of the variable.
+         @return The register of the instruction.
+         */
+        ulong variable(const sample* value);
+
+        //! Add an operation.
+        /** The function adds an instruction that applies an operation to one or two registers.
+         @param code The code of the operation.
+         @param a    The first register.
+         @param b    The second register if the operation is binary.
+         @return The register of the instruction.
+         */
+        ulong apply(Code code, const ulong a, const ulong b = 0ul);
+
+        //! Append a kernel.
+        /** The function appends the instructions of another kernel, the inputs of the other kernel are replaced by registers of this kernel.
+         @param kernel  The kernel to append.
+         @param inputs  The registers that replace the inputs of the kernel.
+         @return The register of the result of the appended kernel.
+         */
+        ulong append(DspKernel const& kernel, vector<ulong> const& inputs);
+
+        //! Set the result.
+        /** The function sets the register that is written to the output, by default it's the last register.
+         @param index The register.
+         */
+        void setResult(const ulong index) noexcept;
+
+        //! Retrieve the result.
+        /** The function retrieves the register that is written to the output.
+         @return The register.
+         */
+        inline ulong getResult() const noexcept
+        {
+            return m_result;
+        }
+
+        //! Retrieve the number of inputs.
+        /** The function retrieves the number of inputs read by the kernel.
+         @return The number of inputs.
+         */
+        inline ulong getNumberOfInputs() const noexcept
+        {
+            return m_ninputs;
+        }
+
+        //! Retrieve the number of instructions.
+        /** The function retrieves the number of instructions of the kernel.
+         @return The number of instructions.
+         */
+        inline ulong getNumberOfInstructions() const noexcept
+        {
+            return (ulong)m_code.size();
+        }
+
+        //! Evaluate the kernel.
+        /** The function evaluates the kernel on vectors, the output can be one of the inputs. A kernel must not be evaluated by two threads at the same time.
+         @param size    The size of the vectors.
+         @param inputs  The input vectors.
+         @param output  The output vector.
+         */
+        void perform(const ulong size, const sample* const* inputs, sample* output) const noexcept;
+    };
+}
+
+
+#endif
+
+
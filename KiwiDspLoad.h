@@ -0,0 +1,297 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_LOAD__
+#define __DEF_KIWI_DSP_LOAD__
+
+#include "KiwiDspSignal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP LOAD                                    //
+    // ================================================================================ //
+
+    //! The dsp load records the durations of the ticks in a rolling histogram.
+    /**
+     The dsp load counts the durations in nanoseconds in logarithmic buckets, eight buckets per octave so a percentile is known within one eighth of its value. The histogram rolls over two windows: when the current window is full, the previous one is cleared and becomes the current one, so the statistics describe between one and two windows of ticks. The audio thread is the only writer, it never locks and never allocates. The statistics can be read from any thread without locking, they are approximate while the audio thread writes.
+     */
+    class DspLoad
+    {
+    public:
+        static const ulong nbuckets = 496ul;
+    private:
+        struct Window
+        {
+            atomic<ulong>   buckets[nbuckets];
+            atomic<ulong>   count;
+            atomic<ulong>   sum;
+            atomic<ulong>   max;
+        };
+
+        Window          m_windows[2];
+        atomic<ulong>   m_current;
+        atomic<ulong>   m_size;
+        atomic<ulong>   m_period;
+        atomic<ulong>   m_nticks;
+        atomic<ulong>   m_noverruns;
+
+        static inline ulong bucket(const ulong duration) noexcept
+        {
+            if(duration < 16ul)
+            {
+                return duration;
+            }
+            ulong msb = 4ul;
+            while(msb < 63ul && (duration >> (msb + 1ul)))
+            {
+                msb++;
+            }
+            return ((msb - 2ul) << 3) | ((duration >> (msb - 3ul)) & 7ul);
+        }
+
+        static inline ulong bound(const ulong index) noexcept
+        {
+            if(index < 16ul)
+            {
+                return index;
+            }
+            const ulong shift = (index >> 3) - 1ul;
+            return ((8ul | (index & 7ul)) << shift) + (1ul << shift) - 1ul;
+        }
+
+        static inline void increase(atomic<ulong>& value, const ulong amount) noexcept
+        {
+            value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+        }
+
+        static inline void reset(Window& window) noexcept
+        {
+            for(ulong i = 0; i < nbuckets; i++)
+            {
+                window.buckets[i].store(0ul, memory_order_relaxed);
+            }
+            window.count.store(0ul, memory_order_relaxed);
+            window.sum.store(0ul, memory_order_relaxed);
+            window.max.store(0ul, memory_order_relaxed);
+        }
+    public:
+
+        //! Constructor.
+        /** The function initializes an empty histogram, the window is 1024 ticks and there is no deadline.
+         */
+        DspLoad() noexcept : m_current(0ul), m_size(1024ul), m_period(0ul), m_nticks(0ul), m_noverruns(0ul)
+        {
+            reset(m_windows[0]);
+            reset(m_windows[1]);
+        }
+
+        //! Retrieve the current time.
+        /** The function retrieves the time of a monotonic clock.
+         @return The time in nanoseconds.
+         */
+        static inline ulong now() noexcept
+        {
+            return (ulong)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        //! Retrieve the current cycle.
+        /** The function retrieves the time stamp counter of the processor, the time of the monotonic clock in nanoseconds is used on the other processors.
+         @return The number of cycles.
+         */
+        static inline ulong cycles() noexcept
+        {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+            return (ulong)__rdtsc();
+#else
+            return now();
+#endif
+        }
+        
+        //! Set the period.
+        /** The function sets the duration of a block, it's the deadline of a tick and the reference of the load.
+         @param period The period in nanoseconds or 0 for no deadline.
+         */
+        inline void setPeriod(const ulong period) noexcept
+        {
+            m_period.store(period, memory_order_relaxed);
+        }
+
+        //! Retrieve the period.
+        /** The function retrieves the duration of a block.
+         @return The period in nanoseconds.
+         */
+        inline ulong getPeriod() const noexcept
+        {
+            return m_period.load(memory_order_relaxed);
+        }
+
+        //! Set the size of the window.
+        /** The function sets the number of ticks of a window of the histogram.
+         @param size The number of ticks.
+         */
+        inline void setWindowSize(const ulong size) noexcept
+        {
+            m_size.store(max(size, 1ul), memory_order_relaxed);
+        }
+
+        //! Record the duration of a tick.
+        /** The function adds a duration to the histogram, it must only be called by the audio thread.
+         @param duration The duration in nanoseconds.
+         */
+        inline void add(const ulong duration) noexcept
+        {
+            ulong current = m_current.load(memory_order_relaxed);
+            if(m_windows[current].count.load(memory_order_relaxed) >= m_size.load(memory_order_relaxed))
+            {
+                current = 1ul - current;
+                reset(m_windows[current]);
+                m_current.store(current, memory_order_release);
+            }
+            Window& window = m_windows[current];
+            increase(window.buckets[bucket(duration)], 1ul);
+            increase(window.count, 1ul);
+            increase(window.sum, duration);
+            if(duration > window.max.load(memory_order_relaxed))
+            {
+                window.max.store(duration, memory_order_relaxed);
+            }
+            increase(m_nticks, 1ul);
+            const ulong period = m_period.load(memory_order_relaxed);
+            if(period && duration > period)
+            {
+                increase(m_noverruns, 1ul);
+            }
+        }
+
+        //! Retrieve the number of ticks.
+        /** The function retrieves the number of ticks recorded since the creation of the histogram.
+         @return The number of ticks.
+         */
+        inline ulong getNumberOfTicks() const noexcept
+        {
+            return m_nticks.load(memory_order_relaxed);
+        }
+
+        //! Retrieve the number of overruns.
+        /** The function retrieves the number of ticks that took longer than the period since the creation of the histogram.
+         @return The number of overruns.
+         */
+        inline ulong getNumberOfOverruns() const noexcept
+        {
+            return m_noverruns.load(memory_order_relaxed);
+        }
+
+        //! Retrieve a percentile of the durations.
+        /** The function retrieves the duration that is longer than a ratio of the ticks of the windows, the duration is the upper bound of its bucket.
+         @param ratio The ratio between 0 and 1, for example 0.99 for the 99th percentile.
+         @return The duration in nanoseconds or 0 if no tick has been recorded.
+         */
+        ulong getPercentile(const double ratio) const noexcept
+        {
+            ulong counts[nbuckets];
+            ulong total = 0ul;
+            for(ulong i = 0; i < nbuckets; i++)
+            {
+                counts[i] = m_windows[0].buckets[i].load(memory_order_relaxed) + m_windows[1].buckets[i].load(memory_order_relaxed);
+                total += counts[i];
+            }
+            if(!total)
+            {
+                return 0ul;
+            }
+            const double clipped = ratio < 0. ? 0. : (ratio > 1. ? 1. : ratio);
+            const ulong rank = max((ulong)ceil(clipped * (double)total), 1ul);
+            ulong count = 0ul;
+            for(ulong i = 0; i < nbuckets; i++)
+            {
+                count += counts[i];
+                if(count >= rank)
+                {
+                    return min(bound(i), getMax());
+                }
+            }
+            return getMax();
+        }
+
+        //! Retrieve the median of the durations.
+        /** The function retrieves the 50th percentile of the durations of the windows.
+         @return The duration in nanoseconds.
+         */
+        inline ulong getMedian() const noexcept
+        {
+            return getPercentile(0.5);
+        }
+
+        //! Retrieve the longest duration.
+        /** The function retrieves the longest duration of the windows.
+         @return The duration in nanoseconds.
+         */
+        inline ulong getMax() const noexcept
+        {
+            return max(m_windows[0].max.load(memory_order_relaxed), m_windows[1].max.load(memory_order_relaxed));
+        }
+
+        //! Retrieve the mean duration.
+        /** The function retrieves the mean duration of the windows.
+         @return The duration in nanoseconds.
+         */
+        inline double getMean() const noexcept
+        {
+            const ulong count = m_windows[0].count.load(memory_order_relaxed) + m_windows[1].count.load(memory_order_relaxed);
+            const ulong sum = m_windows[0].sum.load(memory_order_relaxed) + m_windows[1].sum.load(memory_order_relaxed);
+            return count ? (double)sum / (double)count : 0.;
+        }
+
+        //! Retrieve the load.
+        /** The function retrieves the mean duration of the windows relative to the period, 1 means that the ticks take the whole period.
+         @return The load or 0 if there is no period.
+         */
+        inline double getLoad() const noexcept
+        {
+            const ulong period = getPeriod();
+            return period ? getMean() / (double)period : 0.;
+        }
+
+        //! Retrieve the peak load.
+        /** The function retrieves the longest duration of the windows relative to the period.
+         @return The peak load or 0 if there is no period.
+         */
+        inline double getPeakLoad() const noexcept
+        {
+            const ulong period = getPeriod();
+            return period ? (double)getMax() / (double)period : 0.;
+        }
+    };
+}
+
+
+#endif
+
+
@@ -39,17 +39,30 @@ namespace Kiwi
     m_sample_outs(nullptr),
     m_samplerate(0),
     m_vectorsize(0),
+    m_offset(nullptr),
+    m_staged_ins(nullptr),
+    m_staged_outs(nullptr),
+    m_staging(false),
     m_inplace(true),
-    m_running(false)
+    m_running(false),
+    m_bypass(false),
+    m_dead(false),
+    m_constant(false),
+    m_latency(0ul),
+    m_arrival(0ul),
+    m_ncalls(0ul),
+    m_cycles(0ul),
+    m_mincycles(~0ul),
+    m_maxcycles(0ul),
+    m_queue(nullptr),
+    m_events(nullptr),
+    m_nevents(0ul),
+    m_time(0ul),
+    m_split(false),
+    m_row(0ul),
+    index(0ul)
     {
-        for(ulong i = 0; i < getNumberOfInputs(); i++)
-        {
-            m_inputs.push_back(make_shared<DspInput>(i));
-        }
-        for(ulong i = 0; i < getNumberOfOutputs(); i++)
-        {
-            m_outputs.push_back(make_shared<DspOutput>(i));
-        }
+        ;
     }
     
     DspNode::~DspNode() noexcept
@@ -63,8 +76,26 @@ namespace Kiwi
         {
             delete [] m_sample_outs;
         }
+        if(m_staged_ins)
+        {
+            delete [] m_staged_ins;
+        }
+        if(m_staged_outs)
+        {
+            delete [] m_staged_outs;
+        }
+        if(m_queue)
+        {
+            delete m_queue;
+        }
+        if(m_events)
+        {
+            delete [] m_events;
+        }
         m_inputs.clear();
         m_outputs.clear();
+        m_staged_inputs.clear();
+        m_staged_outputs.clear();
     }
     
     sDspContext DspNode::getContext() const noexcept
@@ -121,8 +152,27 @@ namespace Kiwi
             delete [] m_sample_ins;
         }
         m_sample_ins = new sample*[m_nins];
+        if(m_staged_ins)
+        {
+            delete [] m_staged_ins;
+        }
+        m_staged_ins = new sample*[m_nins];
+        m_inputs.resize(m_nins);
+        m_staged_inputs.resize(m_nins);
+        for(ulong i = 0; i < m_nins; i++)
+        {
+            if(!m_inputs[i])
+            {
+                m_inputs[i] = make_shared<DspInput>(i);
+            }
+            if(!m_staged_inputs[i])
+            {
+                m_staged_inputs[i] = make_shared<DspInput>(i);
+                m_staged_inputs[i]->setNumberOfChannels(m_inputs[i]->getNumberOfChannels());
+            }
+        }
         sDspChain chain = getChain();
-        if(chain)
+        if(chain && state)
         {
             try
             {
@@ -164,8 +214,27 @@ namespace Kiwi
             delete [] m_sample_outs;
         }
         m_sample_outs = new sample*[m_nouts];
+        if(m_staged_outs)
+        {
+            delete [] m_staged_outs;
+        }
+        m_staged_outs = new sample*[m_nouts];
+        m_outputs.resize(m_nouts);
+        m_staged_outputs.resize(m_nouts);
+        for(ulong i = 0; i < m_nouts; i++)
+        {
+            if(!m_outputs[i])
+            {
+                m_outputs[i] = make_shared<DspOutput>(i);
+            }
+            if(!m_staged_outputs[i])
+            {
+                m_staged_outputs[i] = make_shared<DspOutput>(i);
+                m_staged_outputs[i]->setNumberOfChannels(m_outputs[i]->getNumberOfChannels());
+            }
+        }
         sDspChain chain = getChain();
-        if(chain)
+        if(chain && state)
         {
             try
             {
@@ -178,35 +247,47 @@ namespace Kiwi
         }
     }
     
-    void DspNode::addInput(sDspNode node, const ulong index)
+    void DspNode::setNumberOfInputChannels(const ulong index, const ulong nchannels) throw(DspError&)
     {
         if(index < (ulong)m_inputs.size())
         {
-            m_inputs[index]->add(node);
-        }
-    }
-    
-    void DspNode::addOutput(sDspNode node, const ulong index)
-    {
-        if(index < (ulong)m_outputs.size())
-        {
-            m_outputs[index]->add(node);
-        }
-    }
-    
-    void DspNode::removeInput(sDspNode node, const ulong index)
-    {
-        if(index < (ulong)m_outputs.size())
-        {
-            m_inputs[index]->remove(node);
+            sDspChain chain = getChain();
+            const bool state = chain ? chain->suspend() : false;
+            m_inputs[index]->setNumberOfChannels(nchannels);
+            m_staged_inputs[index]->setNumberOfChannels(nchannels);
+            if(chain)
+            {
+                try
+                {
+                    chain->resume(state);
+                }
+                catch(DspError& e)
+                {
+                    throw e;
+                }
+            }
         }
     }
     
-    void DspNode::removeOutput(sDspNode node, const ulong index)
+    void DspNode::setNumberOfOutputChannels(const ulong index, const ulong nchannels) throw(DspError&)
     {
         if(index < (ulong)m_outputs.size())
         {
-            m_outputs[index]->remove(node);
+            sDspChain chain = getChain();
+            const bool state = chain ? chain->suspend() : false;
+            m_outputs[index]->setNumberOfChannels(nchannels);
+            m_staged_outputs[index]->setNumberOfChannels(nchannels);
+            if(chain)
+            {
+                try
+                {
+                    chain->resume(state);
+                }
+                catch(DspError& e)
+                {
+                    throw e;
+                }
+            }
         }
     }
     
@@ -230,46 +311,243 @@ namespace Kiwi
         m_running = status;
     }
     
-    void DspNode::start() throw(DspError&)
+    void DspNode::shouldBypassSilence(const bool status) noexcept
     {
-        sDspChain chain = getChain();
-        if(chain)
+        m_bypass = status;
+    }
+    
+    void DspNode::setLatency(const ulong latency) noexcept
+    {
+        m_latency = latency;
+    }
+    
+    void DspNode::clearProfile() noexcept
+    {
+        m_ncalls.store(0ul, memory_order_relaxed);
+        m_cycles.store(0ul, memory_order_relaxed);
+        m_mincycles.store(~0ul, memory_order_relaxed);
+        m_maxcycles.store(0ul, memory_order_relaxed);
+    }
+    
+    void DspNode::setEventsCapacity(const ulong size)
+    {
+        if(m_queue)
         {
-            stop();
-
-            m_samplerate = chain->getSampleRate();
-            m_vectorsize = chain->getVectorSize();
-            
-            for(ulong i = 0; i < getNumberOfInputs(); i++)
+            delete m_queue;
+            m_queue = nullptr;
+        }
+        if(m_events)
+        {
+            delete [] m_events;
+            m_events = nullptr;
+        }
+        m_nevents = 0ul;
+        if(size)
+        {
+            m_queue  = new DspEventQueue(size);
+            m_events = new DspEvent[m_queue->getCapacity()];
+        }
+    }
+    
+    void DspNode::shouldSplitEvents(const bool status) noexcept
+    {
+        m_split = status;
+    }
+    
+    void DspNode::dispatch(const bool process) noexcept
+    {
+        DspEvent event;
+        const ulong capacity = m_queue->getCapacity();
+        while(m_nevents < capacity && m_queue->pop(event))
+        {
+            ulong i = m_nevents++;
+            while(i && m_events[i-1].time > event.time)
             {
-                try
+                m_events[i] = m_events[i-1];
+                --i;
+            }
+            m_events[i] = event;
+        }
+        
+        const ulong end = m_time + m_vectorsize;
+        ulong ndues = 0ul;
+        while(ndues < m_nevents && m_events[ndues].time < end)
+        {
+            m_events[ndues].time = m_events[ndues].time > m_time ? m_events[ndues].time - m_time : 0ul;
+            ndues++;
+        }
+        
+        if(process && m_split && ndues)
+        {
+            const ulong size = m_vectorsize;
+            ulong pos = 0ul;
+            for(ulong i = 0; i <= ndues; i++)
+            {
+                const ulong next = (i < ndues) ? m_events[i].time : size;
+                if(next > pos)
                 {
-                    m_inputs[i]->start(shared_from_this());
+                    for(ulong j = 0; j < m_nins; j++)
+                    {
+                        m_sample_ins[j] += pos;
+                    }
+                    for(ulong j = 0; j < m_nouts; j++)
+                    {
+                        m_sample_outs[j] += pos;
+                    }
+                    m_vectorsize = next - pos;
+                    perform();
+                    for(ulong j = 0; j < m_nins; j++)
+                    {
+                        m_sample_ins[j] -= pos;
+                    }
+                    for(ulong j = 0; j < m_nouts; j++)
+                    {
+                        m_sample_outs[j] -= pos;
+                    }
+                    m_vectorsize = size;
+                    pos = next;
                 }
-                catch(DspError& e)
+                if(i < ndues)
                 {
-                    m_running = false;
-                    throw e;
+                    receive(m_events[i]);
                 }
-                m_sample_ins[i] = m_inputs[i]->getVector();
             }
-            for(ulong i = 0; i < getNumberOfOutputs(); i++)
+        }
+        else
+        {
+            for(ulong i = 0; i < ndues; i++)
+            {
+                receive(m_events[i]);
+            }
+            if(process)
+            {
+                perform();
+            }
+        }
+        
+        if(ndues)
+        {
+            m_nevents -= ndues;
+            for(ulong i = 0; i < m_nevents; i++)
+            {
+                m_events[i] = m_events[i + ndues];
+            }
+        }
+    }
+    
+    sample* DspNode::allocate(const ulong size) noexcept
+    {
+        sDspChain chain = getChain();
+        if(chain)
+        {
+            return chain->m_arena.allocateSamples(size);
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+    
+    void DspNode::start() throw(DspError&)
+    {
+        sDspChain chain = getChain();
+        if(chain)
+        {
+            // The current plan can still perform the node, it's prepared once the plan has been replaced.
+            if(m_staging)
             {
                 try
                 {
-                    m_outputs[i]->start(shared_from_this());
+                    bind(chain->m_arena, chain->m_index, chain->getVectorSize());
                 }
                 catch(DspError& e)
                 {
-                    m_running = false;
                     throw e;
                 }
-                
-                m_sample_outs[i] = m_outputs[i]->getVector();
+                return;
             }
             
+            if(m_running)
+            {
+                m_running = false;
+                release();
+            }
+
+            m_samplerate = chain->getSampleRate();
+            m_vectorsize = chain->getVectorSize();
+            m_offset     = &chain->m_offset;
+            m_time       = chain->getTime();
+            
+            try
+            {
+                bind(chain->m_arena, chain->m_index, m_vectorsize);
+            }
+            catch(DspError& e)
+            {
+                m_running = false;
+                throw e;
+            }
+            
+            prepare();
+        }
+    }
+    
+    void DspNode::bind(DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&)
+    {
+        sample** ins  = getCompiledSampleInputs();
+        sample** outs = getCompiledSampleOutputs();
+        for(ulong i = 0; i < getNumberOfInputs(); i++)
+        {
+            try
+            {
+                getCompiledInput(i)->start(shared_from_this(), arena, index, vectorsize);
+            }
+            catch(DspError& e)
+            {
+                throw e;
+            }
+            ins[i] = getCompiledInput(i)->getVector();
+        }
+        for(ulong i = 0; i < getNumberOfOutputs(); i++)
+        {
+            try
+            {
+                getCompiledOutput(i)->start(shared_from_this(), arena, index, vectorsize);
+            }
+            catch(DspError& e)
+            {
+                throw e;
+            }
+            outs[i] = getCompiledOutput(i)->getVector();
+        }
+    }
+    
+    void DspNode::install(const ulong samplerate, const ulong vectorsize, const ulong* offset, const ulong time) noexcept
+    {
+        if(m_running)
+        {
+            m_running = false;
+            release();
+        }
+        m_inputs.swap(m_staged_inputs);
+        m_outputs.swap(m_staged_outputs);
+        std::swap(m_sample_ins, m_staged_ins);
+        std::swap(m_sample_outs, m_staged_outs);
+        m_staging = false;
+        
+        // The nodes removed by the optimizer aren't started.
+        if(index && !m_dead)
+        {
+            m_samplerate = samplerate;
+            m_vectorsize = vectorsize;
+            m_offset     = offset;
+            m_time       = time;
             prepare();
         }
+        else
+        {
+            m_offset = nullptr;
+        }
     }
     
     void DspNode::stop()
@@ -278,6 +556,7 @@ namespace Kiwi
         {
             m_running = false;
             release();
+            m_offset  = nullptr;
             for(ulong i = 0; i < getNumberOfInputs(); i++)
             {
                 m_inputs[i]->clear();
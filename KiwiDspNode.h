@@ -26,6 +26,7 @@
 
 #include "KiwiDspIoput.h"
 #include "KiwiDspExpr.h"
+#include "KiwiDspEvent.h"
 
 namespace Kiwi
 {
@@ -40,9 +41,11 @@ namespace Kiwi
     class DspNode: public inheritable_enable_shared_from_this<DspNode>
     {
         friend DspChain;
+        friend DspPlan;
         friend DspOutput;
         friend DspInput;
         friend DspLink;
+        friend DspIndex;
     private:
         
         const wDspChain m_chain;
@@ -52,11 +55,34 @@ namespace Kiwi
         sample**        m_sample_outs;
         ulong           m_samplerate;
         ulong           m_vectorsize;
+        const ulong*    m_offset;
         vector<sDspInput>  m_inputs;
         vector<sDspOutput> m_outputs;
+        sample**        m_staged_ins;
+        sample**        m_staged_outs;
+        vector<sDspInput>  m_staged_inputs;
+        vector<sDspOutput> m_staged_outputs;
+        bool            m_staging;
         
         bool            m_inplace;
         bool            m_running;
+        bool            m_bypass;
+        bool            m_dead;
+        bool            m_constant;
+        shared_ptr<const DspKernel> m_kernel;
+        ulong           m_latency;
+        ulong           m_arrival;
+        atomic<ulong>   m_ncalls;
+        atomic<ulong>   m_cycles;
+        atomic<ulong>   m_mincycles;
+        atomic<ulong>   m_maxcycles;
+        
+        DspEventQueue*  m_queue;
+        DspEvent*       m_events;
+        ulong           m_nevents;
+        ulong           m_time;
+        bool            m_split;
+        ulong           m_row;
         ulong           index;
     public:
         
@@ -112,6 +138,15 @@ namespace Kiwi
             return m_vectorsize;
         }
         
+        //! Retrieve the offset of the current block.
+        /** This function retrieves the position of the block that is processed in the vector of the device. It is always zero unless the chain uses a smaller block size than the device, it should be used by the nodes that read or write the vectors of the device.
+         @return The offset of the current block.
+         */
+        inline ulong getOffset() const noexcept
+        {
+            return m_offset ? *m_offset : 0ul;
+        }
+        
         //! Retrieve the number of inputs of the process.
         /** The method retrieves the number of inputs of the process.
          @return The number of inputs of the process.
@@ -130,8 +165,28 @@ namespace Kiwi
             return m_nouts;
         }
         
+        //! Retrieve the number of channels of an input.
+        /** The method retrieves the number of channels of an input. The channels are planar, the channel c of the input i starts at getInputsSamples()[i] + c * getVectorSize().
+         @param index The index of the input.
+         @return The number of channels of the input.
+         */
+        inline ulong getNumberOfInputChannels(const ulong index) const noexcept
+        {
+            return m_inputs[index]->getNumberOfChannels();
+        }
+        
+        //! Retrieve the number of channels of an output.
+        /** The method retrieves the number of channels of an output. The channels are planar, the channel c of the output i starts at getOutputsSamples()[i] + c * getVectorSize().
+         @param index The index of the output.
+         @return The number of channels of the output.
+         */
+        inline ulong getNumberOfOutputChannels(const ulong index) const noexcept
+        {
+            return m_outputs[index]->getNumberOfChannels();
+        }
+        
         //! Retrieve the inputs sample matrix.
-        /** This function retrieves the inputs sample matrix.
+        /** This function retrieves the inputs sample matrix. The vectors can change from one block to the next, the matrix must be read at each call of the perform method.
          @return The inputs sample matrix.
          */
         inline sample *const *const getInputsSamples() const noexcept
@@ -140,7 +195,7 @@ namespace Kiwi
         }
         
         //! Retrieve the outputs sample matrix.
-        /** This function retrieves the outputs sample matrix.
+        /** This function retrieves the outputs sample matrix. The vectors can change from one block to the next, the matrix must be read at each call of the perform method.
          @return The outputs sample matrix.
          */
         inline sample** getOutputsSamples() const noexcept
@@ -157,6 +212,75 @@ namespace Kiwi
             return m_inplace;
         }
         
+        //! Retrieve the latency of the node.
+        /** This function retrieves the number of samples that the outputs of the node are late on its inputs.
+         @return The latency of the node.
+         */
+        inline ulong getLatency() const noexcept
+        {
+            return m_latency;
+        }
+        
+        //! Retrieve the latency of the inputs of the node.
+        /** This function retrieves the number of samples that the inputs of the node are late on the sources of the chain, the inputs of the node are aligned on the slowest path.
+         @return The latency of the inputs.
+         */
+        inline ulong getInputLatency() const noexcept
+        {
+            return m_arrival;
+        }
+        
+        //! Retrieve the number of profiled calls.
+        /** This function retrieves the number of blocks processed by the node while the chain was profiled (see DspChain::setProfiling).
+         @return The number of calls.
+         */
+        inline ulong getNumberOfCalls() const noexcept
+        {
+            return m_ncalls.load(memory_order_relaxed);
+        }
+        
+        //! Retrieve the profiled cycles.
+        /** This function retrieves the total number of cycles spent by the node while the chain was profiled. The nodes fused in a kernel are profiled as a whole by the last node of the kernel.
+         @return The number of cycles.
+         */
+        inline ulong getCycles() const noexcept
+        {
+            return m_cycles.load(memory_order_relaxed);
+        }
+        
+        //! Retrieve the minimum profiled cycles.
+        /** This function retrieves the minimum number of cycles spent by the node in a block.
+         @return The number of cycles or 0 if the node hasn't been profiled.
+         */
+        inline ulong getMinCycles() const noexcept
+        {
+            return getNumberOfCalls() ? m_mincycles.load(memory_order_relaxed) : 0ul;
+        }
+        
+        //! Retrieve the maximum profiled cycles.
+        /** This function retrieves the maximum number of cycles spent by the node in a block.
+         @return The number of cycles.
+         */
+        inline ulong getMaxCycles() const noexcept
+        {
+            return m_maxcycles.load(memory_order_relaxed);
+        }
+        
+        //! Retrieve the mean profiled cycles.
+        /** This function retrieves the mean number of cycles spent by the node in a block.
+         @return The number of cycles.
+         */
+        inline double getMeanCycles() const noexcept
+        {
+            const ulong ncalls = getNumberOfCalls();
+            return ncalls ? (double)getCycles() / (double)ncalls : 0.;
+        }
+        
+        //! Clear the profile of the node.
+        /** This function resets the number of calls and the cycles of the node.
+         */
+        void clearProfile() noexcept;
+        
         //! Check if the node is running in the dsp chain.
         /** This function checks if the node is running in the dsp chain.
          @return True if the node is running in the dsp chain otherwise it returns false.
@@ -178,8 +302,55 @@ namespace Kiwi
          */
         bool isOutputConnected(const ulong index) const noexcept;
         
+        //! Retrieve the mode of an input for the current block.
+        /** This function retrieves if an input is a constant (scalar) or a signal (vector) for the current block. It should only be called in the perform method.
+         @param index The index of the input.
+         @return The mode of the input.
+         */
+        inline DspMode getInputMode(const ulong index) const noexcept
+        {
+            return m_inputs[index]->getMode();
+        }
+        
+        //! Retrieve the value of an input when it is a scalar.
+        /** This function retrieves the constant value of an input for the current block. It should only be called in the perform method and is only meaningful if the mode of the input is scalar.
+         @param index The index of the input.
+         @return The value of the input.
+         */
+        inline sample getInputValue(const ulong index) const noexcept
+        {
+            return m_inputs[index]->getValue();
+        }
+        
+        //! Check if an input is silent for the current block.
+        /** This function checks if an input is a constant equal to zero for the current block. It should only be called in the perform method.
+         @param index The index of the input.
+         @return True if the input is silent otherwise it returns false.
+         */
+        inline bool isInputSilent(const ulong index) const noexcept
+        {
+            return m_inputs[index]->isSilent();
+        }
+        
+        //! Push an event to the node.
+        /** This function pushes an event to the node, it can be called from any thread. The node receives the event during the block that contains its time, the event is ignored if the node doesn't receive events or if its queue is full.
+         @param time    The time of the event in the sample time of the chain (see DspChain::getTime).
+         @param index   The index of the event.
+         @param value   The value of the event.
+         @return true if the event has been pushed, otherwise false.
+         */
+        inline bool pushEvent(const ulong time, const ulong index, const sample value) noexcept
+        {
+            if(m_queue)
+            {
+                const DspEvent event = {time, index, value};
+                return m_queue->push(event);
+            }
+            return false;
+        }
+        
         //! Retrieve the mathematical expression of the process.
-        /** The method retrieves the mathematical expression of the process.
+        /** The method retrieves the mathematical expression of the process. The expression also declares if the process is pure or a sink, the chain uses these declarations to remove the nodes that don't reach a sink and to evaluate once the nodes that only depend on constants.
          @param expr The mathematical expression of the process.
          */
         virtual void getExpr(DspExpr& expr) const noexcept
@@ -199,6 +370,20 @@ namespace Kiwi
          */
         void setNumberOfOutlets(const ulong nouts) throw(DspError&);
         
+        //! Set the number of channels of an input.
+        /** This function sets the number of channels of an input. The method stop and re-compute the dsp chain.
+         @param index       The index of the input.
+         @param nchannels   The number of channels.
+         */
+        void setNumberOfInputChannels(const ulong index, const ulong nchannels) throw(DspError&);
+        
+        //! Set the number of channels of an output.
+        /** This function sets the number of channels of an output. The method stop and re-compute the dsp chain.
+         @param index       The index of the output.
+         @param nchannels   The number of channels.
+         */
+        void setNumberOfOutputChannels(const ulong index, const ulong nchannels) throw(DspError&);
+        
     protected:
         
         //! Set if the inputs and outputs signals owns the same vectors.
@@ -213,6 +398,53 @@ namespace Kiwi
          */
         void shouldPerform(const bool status) noexcept;
         
+        //! Set if the node should be bypassed when its inputs are silent.
+        /** This function sets if the perform method should be skipped when all the inputs are silent, the outputs are then set to silence. It should only be used by the nodes that don't generate a tail and it should be called before the dsp starts.
+         @param status The bypass status.
+         */
+        void shouldBypassSilence(const bool status) noexcept;
+        
+        //! Set the latency of the node.
+        /** This function sets the number of samples that the outputs of the node are late on its inputs, for example the size of the window of an analysis or the lookahead of a limiter. The chain delays the shorter paths that merge with the node so they stay aligned. It should be called before the dsp starts.
+         @param latency The latency in samples.
+         */
+        void setLatency(const ulong latency) noexcept;
+        
+        //! Set an output to a constant for the current block.
+        /** This function fills an output with a constant and notifies the nodes that read the output that the signal is a scalar. It should only be called in the perform method instead of writing the vector of the output.
+         @param index The index of the output.
+         @param value The constant value.
+         */
+        inline void setOutputScalar(const ulong index, const sample value) noexcept
+        {
+            m_outputs[index]->setScalar(value);
+        }
+        
+        //! Set the capacity of the event queue.
+        /** This function allows the node to receive events. It should be called before the dsp starts, the size is the maximum number of pending events.
+         @param size The capacity of the event queue.
+         */
+        void setEventsCapacity(const ulong size);
+        
+        //! Set if the perform method should be split at the events.
+        /** This function sets if the perform method should be called once per segment between two events, so the events are sample accurate. During a segment the vector size and the sample matrices are the ones of the segment. If the status is false, all the events of the block are received before the perform method. The nodes with several channels per input or output shouldn't split the perform method.
+         @param status The split status.
+         */
+        void shouldSplitEvents(const bool status) noexcept;
+        
+        //! Receive an event.
+        /** The method receives an event during the dsp, the time of the event is its offset in the current block.
+         @param event The event.
+         */
+        virtual void receive(DspEvent const&) noexcept {};
+        
+        //! Allocate a vector of samples from the memory of the chain.
+        /** This function allocates a cleared vector of samples from the arena of the chain. It should only be called in the prepare method, the vector is valid until the node is released and you should never free it.
+         @param size The number of samples.
+         @return The vector or nullptr if the allocation failed.
+         */
+        sample* allocate(const ulong size) noexcept;
+        
         //! Prepare the process for the dsp.
         /** The method preprares the dsp.
          @param node The dsp node that owns the dsp informations and should be configured.
@@ -234,55 +466,112 @@ namespace Kiwi
     private:
         
         //! Prepare the node to process.
-        /** This function prepares the node to process. It allocates the signals for the inputs and the outputs.
+        /** This function prepares the node to process. It allocates the signals for the inputs and the outputs. If the chain stages a compilation, only the staged inputs and outputs are prepared, the node is prepared when the plan that uses them is installed.
          @param The chain that owns the node.
          */
         void start() throw(DspError&);
         
-        //! Call once the process method of the inputs and of the process class.
-        /** This function calls once the process.
+        //! Allocate the signals of the node.
+        /** This function prepares the inputs and the outputs that are compiled and fills their sample matrices.
+         @param arena       The arena of the chain.
+         @param index       The index of the links of the chain.
+         @param vectorsize  The vector size of the chain.
          */
-        inline void tick() noexcept
+        void bind(DspArena& arena, DspIndex const& index, const ulong vectorsize) throw(DspError&);
+        
+        //! Switch to the staged state.
+        /** This function releases the node, swaps the current inputs and outputs with the staged ones and prepares the node if the chain started it. It must be called between two blocks, by the thread that ticks the chain or while the chain isn't ticked.
+         @param samplerate  The sample rate of the chain.
+         @param vectorsize  The vector size of the chain.
+         @param offset      The offset of the current tick in the vector of the context.
+         @param time        The time of the chain in samples.
+         */
+        void install(const ulong samplerate, const ulong vectorsize, const ulong* offset, const ulong time) noexcept;
+        
+        //! Retrieve an input that is compiled.
+        /** This function retrieves an input of the staged state while the chain stages a compilation, otherwise an input of the current state.
+         @param index The index of the input.
+         @return The input.
+         */
+        inline DspInput* getCompiledInput(const ulong index) const noexcept
         {
-            for(ulong i = 0; i < m_nins; i++)
-            {
-                m_inputs[i]->perform();
-            }
-            perform();
+            return (m_staging ? m_staged_inputs[index] : m_inputs[index]).get();
         }
         
-        //! Notify the process that the dsp has been stopped.
-        /** This function notifies that the dsp has been stopped.
+        //! Retrieve an output that is compiled.
+        /** This function retrieves an output of the staged state while the chain stages a compilation, otherwise an output of the current state.
+         @param index The index of the output.
+         @return The output.
          */
-        void stop();
+        inline DspOutput* getCompiledOutput(const ulong index) const noexcept
+        {
+            return (m_staging ? m_staged_outputs[index] : m_outputs[index]).get();
+        }
         
-        //! Add a node to an input.
-        /** This function adds a node to an input.
-         @param node The node to add.
-         @param index The index of the input.
+        //! Retrieve the inputs sample matrix that is compiled.
+        /** This function retrieves the inputs sample matrix of the staged state while the chain stages a compilation, otherwise the current one.
+         @return The inputs sample matrix.
          */
-        void addInput(sDspNode node, const ulong index);
+        inline sample** getCompiledSampleInputs() const noexcept
+        {
+            return m_staging ? m_staged_ins : m_sample_ins;
+        }
         
-        //! Add a node to an output.
-        /** This function adds a node to an output.
-         @param node The node to add.
-         @param index The index of the output.
+        //! Retrieve the outputs sample matrix that is compiled.
+        /** This function retrieves the outputs sample matrix of the staged state while the chain stages a compilation, otherwise the current one.
+         @return The outputs sample matrix.
          */
-        void addOutput(sDspNode node, const ulong index);
+        inline sample** getCompiledSampleOutputs() const noexcept
+        {
+            return m_staging ? m_staged_outs : m_sample_outs;
+        }
         
-        //! Remove a node from an input.
-        /** This function removes a node from an input.
-         @param node The node to remove.
-         @param index The index of the input.
+        //! Call once the process method of the process class.
+        /** This function calls once the process, the inputs must have been merged before.
          */
-        void removeInput(sDspNode node, const ulong index);
+        inline void tick() noexcept
+        {
+            bool silent = m_bypass && m_nins;
+            for(ulong i = 0; i < m_nins && silent; i++)
+            {
+                silent = m_inputs[i]->isSilent();
+            }
+            if(silent)
+            {
+                for(ulong i = 0; i < m_nouts; i++)
+                {
+                    m_outputs[i]->setScalar(0.);
+                }
+                if(m_queue)
+                {
+                    dispatch(false);
+                }
+            }
+            else if(m_queue)
+            {
+                dispatch(true);
+            }
+            else
+            {
+                perform();
+            }
+            for(ulong i = 0; i < m_nouts; i++)
+            {
+                m_outputs[i]->update();
+            }
+            m_time += m_vectorsize;
+        }
         
-        //! Remove a node from an output.
-        /** This function removes a node from an output.
-         @param node The node to remove.
-         @param index The index of the output.
+        //! Deliver the events of the current block.
+        /** This function pops the pending events, delivers the ones of the current block and calls the perform method if needed.
+         @param process If the perform method should be called.
          */
-        void removeOutput(sDspNode node, const ulong index);
+        void dispatch(const bool process) noexcept;
+        
+        //! Notify the process that the dsp has been stopped.
+        /** This function notifies that the dsp has been stopped.
+         */
+        void stop();
     };
 }
 
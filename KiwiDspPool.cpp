@@ -0,0 +1,196 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#include "KiwiDspPool.h"
+#include "KiwiDspChain.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP TASK QUEUE                              //
+    // ================================================================================ //
+
+    DspTaskQueue::DspTaskQueue(const ulong capacity) :
+    m_mask(1ul),
+    m_top(0l),
+    m_bottom(0l)
+    {
+        while(m_mask < capacity)
+        {
+            m_mask <<= 1;
+        }
+        m_tasks = unique_ptr<atomic<ulong>[]>(new atomic<ulong>[m_mask]);
+        m_mask--;
+    }
+
+    // ================================================================================ //
+    //                                      DSP POOL                                    //
+    // ================================================================================ //
+
+    DspPool::DspPool(const ulong nthreads, vector<ulong> const& cores) :
+    m_plan(nullptr),
+    m_generation(0ul),
+    m_signal(0),
+    m_nsleepers(0ul),
+    m_passes(new atomic<ulong>[nthreads]),
+    m_running(true)
+    {
+        for(ulong i = 0; i < nthreads; i++)
+        {
+            m_passes[i].store(0ul);
+        }
+        for(ulong i = 0; i < nthreads; i++)
+        {
+            m_threads.push_back(thread(&DspPool::run, this, i));
+#if defined(__linux__)
+            // The errors are ignored if the system doesn't allow it.
+            if(!cores.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cores[i % cores.size()], &set);
+                pthread_setaffinity_np(m_threads[i].native_handle(), sizeof(cpu_set_t), &set);
+            }
+            sched_param param;
+            param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+            pthread_setschedparam(m_threads[i].native_handle(), SCHED_FIFO, &param);
+#endif
+        }
+    }
+
+    DspPool::~DspPool()
+    {
+        m_running = false;
+        m_signal.fetch_add(1);
+        wake();
+        for(vector<thread>::size_type i = 0; i < m_threads.size(); i++)
+        {
+            m_threads[i].join();
+        }
+    }
+
+    void DspPool::sleep(const int signal) noexcept
+    {
+#if defined(__linux__)
+        // The futex returns at once if the signal has changed since it was read, so a wake can't be lost.
+        syscall(SYS_futex, reinterpret_cast<int*>(&m_signal), FUTEX_WAIT_PRIVATE, signal, nullptr, nullptr, 0);
+#else
+        unique_lock<mutex> lock(m_mutex);
+        m_condition.wait(lock, [this, signal]()
+        {
+            return m_signal.load() != signal;
+        });
+#endif
+    }
+
+    void DspPool::wake() noexcept
+    {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<int*>(&m_signal), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+        // The mutex is taken between the change of the signal and the notification so a worker can't miss it.
+        {
+            lock_guard<mutex> guard(m_mutex);
+        }
+        m_condition.notify_all();
+#endif
+    }
+
+    void DspPool::run(const ulong index) noexcept
+    {
+        ulong generation = 0ul;
+        while(m_running)
+        {
+            // The worker spins a while before sleeping so it's awake for the next tasks of a block.
+            for(ulong i = 0; i < 4096ul && m_running && m_generation.load() == generation; i++)
+            {
+                this_thread::yield();
+            }
+            if(m_generation.load() == generation)
+            {
+                // The worker counts itself as a sleeper before it reads the signal, so the ticking thread can't skip the wake.
+                m_nsleepers.fetch_add(1ul);
+                const int signal = m_signal.load();
+                if(m_running && m_generation.load() == generation)
+                {
+                    sleep(signal);
+                }
+                m_nsleepers.fetch_sub(1ul);
+                continue;
+            }
+            
+            // The pass is published before the plan is read so synchronize can wait for the worker.
+            generation = m_generation.load();
+            m_passes[index].store(generation);
+            const DspPlan* plan = m_plan.load();
+            if(plan)
+            {
+                plan->work(index + 1ul);
+            }
+            m_passes[index].store(0ul);
+        }
+    }
+
+    void DspPool::perform(const DspPlan* plan) noexcept
+    {
+        plan->prepare();
+        m_plan.store(plan);
+        m_generation.fetch_add(1ul);
+        m_signal.fetch_add(1);
+        if(m_nsleepers.load())
+        {
+            wake();
+        }
+        plan->work(0ul);
+        
+        // The workers that are late find no plan, the ones that are inside the plan leave it once they see that the tasks are done.
+        m_plan.store(nullptr);
+    }
+    
+    void DspPool::synchronize() const noexcept
+    {
+        // A worker that enters a plan after this point reads a newer plan or none.
+        const ulong generation = m_generation.load();
+        for(vector<thread>::size_type i = 0; i < m_threads.size(); i++)
+        {
+            ulong pass = m_passes[i].load();
+            while(pass && pass <= generation)
+            {
+                this_thread::yield();
+                pass = m_passes[i].load();
+            }
+        }
+    }
+}
+
+
+
@@ -0,0 +1,180 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_POOL__
+#define __DEF_KIWI_DSP_POOL__
+
+#include "KiwiDspSignal.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP TASK QUEUE                              //
+    // ================================================================================ //
+
+    //! The dsp task queue is the work-stealing deque of one thread.
+    /**
+     The dsp task queue is a bounded Chase-Lev deque of task indices. The owner thread pushes and pops the tasks at the bottom and the other threads steal the tasks at the top, none of the operations lock or allocate. The capacity must be greater than the number of tasks pushed during one pass. The queue is never reset, the positions only grow so a thread that is late from the previous pass can't take a task of the next pass in place of another one.
+     */
+    class DspTaskQueue
+    {
+    private:
+        unique_ptr<atomic<ulong>[]> m_tasks;
+        ulong                       m_mask;
+        atomic<long>                m_top;
+        atomic<long>                m_bottom;
+    public:
+        static const ulong empty = ~0ul;
+
+        //! Constructor.
+        /** The function allocates the queue, the capacity is rounded up to a power of two.
+         @param capacity The minimum capacity of the queue.
+         */
+        DspTaskQueue(const ulong capacity);
+
+        //! Push a task.
+        /** The function pushes a task at the bottom of the queue, it must only be called by the owner thread.
+         @param task The index of the task.
+         */
+        inline void push(const ulong task) noexcept
+        {
+            const long bottom = m_bottom.load(memory_order_relaxed);
+            m_tasks[(ulong)bottom & m_mask].store(task, memory_order_relaxed);
+            m_bottom.store(bottom + 1l, memory_order_release);
+        }
+
+        //! Pop a task.
+        /** The function pops the last task pushed, it must only be called by the owner thread.
+         @return The index of the task or empty.
+         */
+        inline ulong pop() noexcept
+        {
+            const long bottom = m_bottom.load(memory_order_relaxed) - 1l;
+            m_bottom.store(bottom, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            long top = m_top.load(memory_order_relaxed);
+            ulong task = empty;
+            if(top <= bottom)
+            {
+                task = m_tasks[(ulong)bottom & m_mask].load(memory_order_relaxed);
+                if(top == bottom)
+                {
+                    if(!m_top.compare_exchange_strong(top, top + 1l, memory_order_seq_cst, memory_order_relaxed))
+                    {
+                        task = empty;
+                    }
+                    m_bottom.store(bottom + 1l, memory_order_relaxed);
+                }
+            }
+            else
+            {
+                m_bottom.store(bottom + 1l, memory_order_relaxed);
+            }
+            return task;
+        }
+
+        //! Steal a task.
+        /** The function steals the first task pushed, it can be called by any thread.
+         @return The index of the task or empty.
+         */
+        inline ulong steal() noexcept
+        {
+            long top = m_top.load(memory_order_acquire);
+            atomic_thread_fence(memory_order_seq_cst);
+            const long bottom = m_bottom.load(memory_order_acquire);
+            if(top < bottom)
+            {
+                const ulong task = m_tasks[(ulong)top & m_mask].load(memory_order_relaxed);
+                if(m_top.compare_exchange_strong(top, top + 1l, memory_order_seq_cst, memory_order_relaxed))
+                {
+                    return task;
+                }
+            }
+            return empty;
+        }
+    };
+
+    // ================================================================================ //
+    //                                      DSP POOL                                    //
+    // ================================================================================ //
+
+    //! The dsp pool owns the worker threads of a chain.
+    /**
+     The dsp pool runs the independent nodes of a plan concurrently. The thread that ticks the chain wakes the workers, takes part in the work and returns once all the tasks of the plan are done, it never waits for the workers. The workers spin a while then sleep until the generation of the pool changes, on Linux they sleep on a futex so waking them doesn't take a lock. A plan can only be deleted once no worker can be inside it (see synchronize). The workers get a real-time priority when the system allows it and they can be pinned to a list of cores.
+     */
+    class DspPool
+    {
+    private:
+        vector<thread>              m_threads;
+        atomic<const DspPlan*>      m_plan;
+        atomic<ulong>               m_generation;
+        atomic<int>                 m_signal;
+        atomic<ulong>               m_nsleepers;
+        unique_ptr<atomic<ulong>[]> m_passes;
+        atomic_bool                 m_running;
+        mutex                       m_mutex;
+        condition_variable          m_condition;
+
+        void run(const ulong index) noexcept;
+        void sleep(const int signal) noexcept;
+        void wake() noexcept;
+    public:
+
+        //! Constructor.
+        /** The function creates the worker threads. The worker i is pinned to the core cores[i % cores.size()], the workers aren't pinned if the list is empty.
+         @param nthreads The number of worker threads.
+         @param cores    The cores of the workers.
+         */
+        DspPool(const ulong nthreads, vector<ulong> const& cores = vector<ulong>());
+
+        //! Destructor.
+        /** The function stops and joins the worker threads.
+         */
+        ~DspPool();
+
+        //! Retrieve the number of threads.
+        /** The function retrieves the number of worker threads, the thread that ticks the chain isn't counted.
+         @return The number of threads.
+         */
+        inline ulong getNumberOfThreads() const noexcept
+        {
+            return (ulong)m_threads.size();
+        }
+
+        //! Perform a plan.
+        /** The function performs the tasks of a plan with the worker threads, it returns once all the tasks are done. Some workers can still be leaving the plan.
+         @param plan The plan.
+         */
+        void perform(const DspPlan* plan) noexcept;
+
+        //! Wait until the workers have left the previous plans.
+        /** The function waits until no worker can be inside a plan that isn't performed anymore. It must be called by a control thread before a plan is deleted, once the thread that ticks the chain has left the plan.
+         */
+        void synchronize() const noexcept;
+    };
+}
+
+
+#endif
+
+
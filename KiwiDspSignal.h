@@ -53,6 +53,8 @@ namespace Kiwi
     typedef weak_ptr<const DspNode>     wcDspNode;
     
     class DspChain;
+    class DspPlan;
+    class DspIndex;
     typedef shared_ptr<DspChain>        sDspChain;
     typedef weak_ptr<DspChain>          wDspChain;
     typedef shared_ptr<const DspChain>  scDspChain;
@@ -72,6 +74,9 @@ namespace Kiwi
     
     typedef set<weak_ptr<DspNode>, owner_less< weak_ptr<DspNode>>> DspNodeSet;
     
+    //! The mode of a signal for one block.
+    /** A scalar signal is a constant for the whole block (zero for silence), its value is known without reading the vector. A vector signal has to be read sample by sample.
+     */
     enum DspMode : bool
     {
         DspScalar = false,
@@ -208,7 +213,7 @@ namespace Kiwi
 #elif __CATLAS__
             catlas_sset((const int)vectorsize, in1, out1, 1);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, out1 += 8)
                 {
@@ -237,7 +242,7 @@ namespace Kiwi
 #elif __CATLAS__
             catlas_sset((const int)vectorsize, in1, out1, 1);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, out1 += 8)
                 {
@@ -283,7 +288,7 @@ namespace Kiwi
 #ifdef __APPLE__
             vDSP_vsadd(out1, 1, &in1, out1, 1, vectorsize);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, out1 += 8)
                 {
@@ -310,7 +315,7 @@ namespace Kiwi
 #ifdef __APPLE__
             vDSP_vsaddD(out1, 1, &in1, out1, 1, vectorsize);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, out1 += 8)
                 {
@@ -337,7 +342,7 @@ namespace Kiwi
 #if defined (__APPLE__) || defined(__CBLAS__)
             cblas_saxpy((const int)vectorsize, 1., in1, 1, out1, 1);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, in1 += 8, out1 += 8)
                 {
@@ -364,7 +369,7 @@ namespace Kiwi
 #if defined (__APPLE__) || defined(__CBLAS__)
             cblas_daxpy((const int)vectorsize, 1., in1, 1, out1, 1);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, in1 += 8, out1 += 8)
                 {
@@ -394,7 +399,7 @@ namespace Kiwi
             cblas_scopy(vectorsize, in1, 1, out1, 1);
             cblas_saxpy(vectorsize, 1., in2, 1, out1, 1);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, in1 += 8, in2 += 8, out1 += 8)
                 {
@@ -422,7 +427,7 @@ namespace Kiwi
             cblas_dcopy(vectorsize, in1, 1, out1, 1);
             cblas_daxpy(vectorsize, 1., in2, 1, out1, 1);
 #else
-            if(vectorsize&7)
+            if(!(vectorsize&7))
             {
                 for(; vectorsize; vectorsize -= 8, in1 += 8, in2 += 8, out1 += 8)
                 {
@@ -0,0 +1,99 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_SNAPSHOT__
+#define __DEF_KIWI_DSP_SNAPSHOT__
+
+#include "KiwiDspSignal.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP SNAPSHOT                                //
+    // ================================================================================ //
+
+    //! The dsp snapshot publishes an immutable object to the audio thread.
+    /**
+     The dsp snapshot is a read-copy-update pointer. The audio thread reads the current object without lock, a control thread publishes a new object with an atomic swap then waits until no reader is inside the previous object before deleting it. The readers never wait, the control threads never delete memory that can still be read.
+     */
+    template <class Type> class DspSnapshot
+    {
+    private:
+        atomic<Type*>   m_value;
+        atomic<ulong>   m_nreaders;
+    public:
+
+        //! Constructor.
+        /** The function initializes an empty snapshot.
+         */
+        DspSnapshot() noexcept : m_value(nullptr), m_nreaders(0ul)
+        {
+            ;
+        }
+
+        //! Destructor.
+        /** The function deletes the current object.
+         */
+        ~DspSnapshot() noexcept
+        {
+            delete m_value.load();
+        }
+
+        //! Enter the snapshot.
+        /** The function retrieves the current object, it stays valid until the reader leaves the snapshot.
+         @return The current object or nullptr.
+         */
+        inline const Type* acquire() noexcept
+        {
+            m_nreaders.fetch_add(1ul);
+            return m_value.load();
+        }
+
+        //! Leave the snapshot.
+        /** The function must be called once the reader doesn't use the object anymore.
+         */
+        inline void release() noexcept
+        {
+            m_nreaders.fetch_sub(1ul, memory_order_release);
+        }
+
+        //! Publish a new object.
+        /** The function replaces the current object, waits until the readers have left the previous object and deletes it. It must never be called by a reader.
+         @param value The new object or nullptr.
+         */
+        void publish(Type* value) noexcept
+        {
+            Type* previous = m_value.exchange(value);
+            while(m_nreaders.load())
+            {
+                this_thread::yield();
+            }
+            delete previous;
+        }
+    };
+}
+
+
+#endif
+
+
@@ -0,0 +1,377 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+
+#ifndef __DEF_KIWI_DSP_STATIC__
+#define __DEF_KIWI_DSP_STATIC__
+
+#include "KiwiDspNode.h"
+#include <tuple>
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP STATIC LINK                             //
+    // ================================================================================ //
+    
+    //! The index of the inputs and the outputs of a static graph in a static link.
+    constexpr ulong DspStaticIo = ~0ul;
+    
+    //! The static link connects an output of a processor to an input of another processor of a static graph.
+    /**
+     The static link is resolved at compile time. The processors are referenced by their position in the graph, DspStaticIo as source refers to the inputs of the graph and DspStaticIo as destination refers to the outputs of the graph.
+     */
+    template <ulong From, ulong Output, ulong To, ulong Input> struct DspStaticLink
+    {
+        static constexpr ulong from     = From;
+        static constexpr ulong output   = Output;
+        static constexpr ulong to       = To;
+        static constexpr ulong input    = Input;
+    };
+    
+    //! The list of the static links of a static graph.
+    /**
+     The list checks the links at compile time.
+     */
+    template <class... Links> struct DspStaticLinks;
+    
+    template <> struct DspStaticLinks<>
+    {
+        static constexpr ulong count(const ulong, const ulong) noexcept
+        {
+            return 0ul;
+        }
+        
+        template <class Layout> static constexpr bool valid(const ulong, const ulong) noexcept
+        {
+            return true;
+        }
+        
+        static constexpr bool unique() noexcept
+        {
+            return true;
+        }
+    };
+    
+    template <class Link, class... Links> struct DspStaticLinks<Link, Links...>
+    {
+        //! Count the links that reach an input.
+        static constexpr ulong count(const ulong to, const ulong input) noexcept
+        {
+            return (Link::to == to && Link::input == input ? 1ul : 0ul) + DspStaticLinks<Links...>::count(to, input);
+        }
+        
+        //! Check that the links go forward and that the ports exist.
+        template <class Layout> static constexpr bool valid(const ulong ninputs, const ulong noutputs) noexcept
+        {
+            return (Link::from != DspStaticIo || Link::to != DspStaticIo) &&
+            (Link::from == DspStaticIo ? Link::output < ninputs : (Link::from < Layout::nprocessors && Link::output < Layout::outputs(Link::from))) &&
+            (Link::to == DspStaticIo ? Link::input < noutputs : (Link::to < Layout::nprocessors && Link::input < Layout::inputs(Link::to))) &&
+            (Link::from == DspStaticIo || Link::to == DspStaticIo || Link::from < Link::to) &&
+            DspStaticLinks<Links...>::template valid<Layout>(ninputs, noutputs);
+        }
+        
+        //! Check that each input is reached by one link at most.
+        static constexpr bool unique() noexcept
+        {
+            return DspStaticLinks<Link, Links...>::count(Link::to, Link::input) == 1ul && DspStaticLinks<Links...>::unique();
+        }
+    };
+    
+    // ================================================================================ //
+    //                                      DSP STATIC LAYOUT                           //
+    // ================================================================================ //
+    
+    //! The static layout computes the positions of the ports of the processors at compile time.
+    /**
+     The static layout counts the inputs and the outputs of all the processors, the ports of a processor are stored after the ports of the previous processors.
+     */
+    template <class... Processors> struct DspStaticLayout;
+    
+    template <> struct DspStaticLayout<>
+    {
+        static constexpr ulong nprocessors = 0ul;
+        static constexpr ulong ninputs = 0ul;
+        static constexpr ulong noutputs = 0ul;
+        
+        static constexpr ulong inputs(const ulong) noexcept
+        {
+            return 0ul;
+        }
+        
+        static constexpr ulong outputs(const ulong) noexcept
+        {
+            return 0ul;
+        }
+        
+        static constexpr ulong inputsOffset(const ulong) noexcept
+        {
+            return 0ul;
+        }
+        
+        static constexpr ulong outputsOffset(const ulong) noexcept
+        {
+            return 0ul;
+        }
+    };
+    
+    template <class Processor, class... Processors> struct DspStaticLayout<Processor, Processors...>
+    {
+        typedef DspStaticLayout<Processors...> Next;
+        static constexpr ulong nprocessors = 1ul + Next::nprocessors;
+        static constexpr ulong ninputs = Processor::ninputs + Next::ninputs;
+        static constexpr ulong noutputs = Processor::noutputs + Next::noutputs;
+        
+        static constexpr ulong inputs(const ulong index) noexcept
+        {
+            return index ? Next::inputs(index - 1ul) : Processor::ninputs;
+        }
+        
+        static constexpr ulong outputs(const ulong index) noexcept
+        {
+            return index ? Next::outputs(index - 1ul) : Processor::noutputs;
+        }
+        
+        static constexpr ulong inputsOffset(const ulong index) noexcept
+        {
+            return index ? Processor::ninputs + Next::inputsOffset(index - 1ul) : 0ul;
+        }
+        
+        static constexpr ulong outputsOffset(const ulong index) noexcept
+        {
+            return index ? Processor::noutputs + Next::outputsOffset(index - 1ul) : 0ul;
+        }
+    };
+    
+    // ================================================================================ //
+    //                                      DSP STATIC GRAPH                            //
+    // ================================================================================ //
+    
+    //! The static graph processes a topology that is fixed at compile time.
+    /**
+     The static graph holds its processors by value and calls them in the order of the declaration without virtual call, so the compiler can inline the whole tick. A processor is a class with the constants ninputs and noutputs and the methods prepare(samplerate, vectorsize) and perform(size, inputs, outputs). The links must go from a processor to a following one and an input can only receive one link, a processor must be used to mix several signals. The positions of the buffers are computed at compile time, the inputs that aren't connected read zeros. The graph doesn't allocate, the owner gives it a buffer of nvectors vectors.
+     @code
+     typedef DspStaticGraph<1, 1, DspStaticLinks<DspStaticLink<DspStaticIo, 0, 0, 0>, DspStaticLink<0, 0, 1, 0>, DspStaticLink<1, 0, DspStaticIo, 0>>, Gain, Clip> Channel;
+     @endcode
+     */
+    template <ulong Nins, ulong Nouts, class Links, class... Processors> class DspStaticGraph
+    {
+    public:
+        typedef DspStaticLayout<Processors...> Layout;
+        static constexpr ulong ninputs      = Nins;
+        static constexpr ulong noutputs     = Nouts;
+        static constexpr ulong nprocessors  = sizeof...(Processors);
+        static constexpr ulong nvectors     = Layout::noutputs + 1ul;
+        
+        static_assert(Links::template valid<Layout>(Nins, Nouts), "The static links must go forward and reach existing ports.");
+        static_assert(Links::unique(), "An input of a static graph can only receive one link.");
+    private:
+        tuple<Processors...>    m_processors;
+        ulong                   m_vectorsize;
+        const sample*           m_inputs[Layout::ninputs + 1ul];
+        sample*                 m_outputs[Layout::noutputs + 1ul];
+        const sample*           m_results[Nouts + 1ul];
+        
+        inline void bind(DspStaticLinks<>) noexcept
+        {
+            ;
+        }
+        
+        template <class Link, class... Next> inline void bind(DspStaticLinks<Link, Next...>) noexcept
+        {
+            if(Link::from != DspStaticIo)
+            {
+                const sample* source = m_outputs[Layout::outputsOffset(Link::from) + Link::output];
+                if(Link::to == DspStaticIo)
+                {
+                    m_results[Link::input] = source;
+                }
+                else
+                {
+                    m_inputs[Layout::inputsOffset(Link::to) + Link::input] = source;
+                }
+            }
+            bind(DspStaticLinks<Next...>());
+        }
+        
+        inline void receive(const sample* const*, DspStaticLinks<>) noexcept
+        {
+            ;
+        }
+        
+        template <class Link, class... Next> inline void receive(const sample* const* inputs, DspStaticLinks<Link, Next...>) noexcept
+        {
+            if(Link::from == DspStaticIo)
+            {
+                m_inputs[Layout::inputsOffset(Link::to) + Link::input] = inputs[Link::output];
+            }
+            receive(inputs, DspStaticLinks<Next...>());
+        }
+        
+        template <ulong Index> inline void prepare(const ulong, const ulong, false_type) noexcept
+        {
+            ;
+        }
+        
+        template <ulong Index> inline void prepare(const ulong samplerate, const ulong vectorsize, true_type) noexcept
+        {
+            std::get<Index>(m_processors).prepare(samplerate, vectorsize);
+            prepare<Index + 1ul>(samplerate, vectorsize, integral_constant<bool, (Index + 1ul < nprocessors)>());
+        }
+        
+        template <ulong Index> inline void tick(false_type) noexcept
+        {
+            ;
+        }
+        
+        template <ulong Index> inline void tick(true_type) noexcept
+        {
+            std::get<Index>(m_processors).perform(m_vectorsize, m_inputs + Layout::inputsOffset(Index), m_outputs + Layout::outputsOffset(Index));
+            tick<Index + 1ul>(integral_constant<bool, (Index + 1ul < nprocessors)>());
+        }
+    public:
+        
+        //! Constructor.
+        /** The function default constructs the processors.
+         */
+        DspStaticGraph() noexcept : m_vectorsize(0ul)
+        {
+            ;
+        }
+        
+        //! Retrieve a processor.
+        /** The function retrieves a processor by its position in the graph.
+         @return The processor.
+         */
+        template <ulong Index> inline typename tuple_element<Index, tuple<Processors...>>::type& get() noexcept
+        {
+            return std::get<Index>(m_processors);
+        }
+        
+        //! Prepare the graph.
+        /** The function clears the buffer, resolves the links and prepares the processors. It must be called before the graph is performed and whenever the vector size or the buffer changes.
+         @param samplerate The sample rate.
+         @param vectorsize The vector size.
+         @param buffer     The nvectors vectors of the graph, they must stay valid as long as the graph is performed.
+         */
+        void prepare(const ulong samplerate, const ulong vectorsize, sample* buffer) noexcept
+        {
+            m_vectorsize = vectorsize;
+            Signal::vclear(nvectors * vectorsize, buffer);
+            
+            // The last vector of the buffer stays empty for the inputs and the outputs that aren't connected.
+            const sample* zero = buffer + Layout::noutputs * vectorsize;
+            for(ulong i = 0; i < Layout::noutputs; i++)
+            {
+                m_outputs[i] = buffer + i * vectorsize;
+            }
+            for(ulong i = 0; i < Layout::ninputs; i++)
+            {
+                m_inputs[i] = zero;
+            }
+            for(ulong i = 0; i < Nouts; i++)
+            {
+                m_results[i] = zero;
+            }
+            bind(Links());
+            prepare<0ul>(samplerate, vectorsize, integral_constant<bool, (0ul < nprocessors)>());
+        }
+        
+        //! Perform the graph.
+        /** The function processes one vector, the outputs can be the inputs.
+         @param inputs  The input vectors.
+         @param outputs The output vectors.
+         */
+        inline void perform(const sample* const* inputs, sample* const* outputs) noexcept
+        {
+            receive(inputs, Links());
+            tick<0ul>(integral_constant<bool, (0ul < nprocessors)>());
+            for(ulong i = 0; i < Nouts; i++)
+            {
+                Signal::vcopy(m_vectorsize, m_results[i], outputs[i]);
+            }
+        }
+    };
+    
+    // ================================================================================ //
+    //                                      DSP STATIC NODE                             //
+    // ================================================================================ //
+    
+    //! The static node uses a static graph as a node of a dynamic chain.
+    /**
+     The static node has the inputs and the outputs of its graph. The chain sees one node, the processors of the graph are called by the inlined tick of the graph.
+     */
+    template <class Graph> class DspStaticNode : public DspNode
+    {
+    private:
+        Graph m_graph;
+    public:
+        
+        //! Constructor.
+        /** The function creates the inputs and the outputs of the graph.
+         @param chain The dsp chain.
+         */
+        DspStaticNode(sDspChain chain) : DspNode(chain)
+        {
+            setNumberOfInlets(Graph::ninputs);
+            setNumberOfOutlets(Graph::noutputs);
+        }
+        
+        //! Retrieve the graph.
+        /** The function retrieves the graph to access its processors.
+         @return The graph.
+         */
+        inline Graph& getGraph() noexcept
+        {
+            return m_graph;
+        }
+        
+        //! Prepare the node.
+        /** The function allocates the buffer of the graph from the memory of the chain and prepares the graph with the sample rate and the vector size of the node. The node doesn't perform if the buffer can't be allocated.
+         */
+        void prepare() noexcept override
+        {
+            sample* buffer = allocate(Graph::nvectors * getVectorSize());
+            if(!buffer)
+            {
+                shouldPerform(false);
+                return;
+            }
+            m_graph.prepare(getSampleRate(), getVectorSize(), buffer);
+            shouldPerform(true);
+        }
+        
+        //! Perform the node.
+        /** The function performs the graph.
+         */
+        void perform() noexcept override
+        {
+            m_graph.perform(getInputsSamples(), getOutputsSamples());
+        }
+    };
+}
+
+
+#endif
+
+
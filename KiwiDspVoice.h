@@ -0,0 +1,360 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_VOICE__
+#define __DEF_KIWI_DSP_VOICE__
+
+#include "KiwiDspNode.h"
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP VOICE LANES                             //
+    // ================================================================================ //
+
+    //! The voice lanes process a group of scalar voices as a bank of lanes.
+    /**
+     A bank processes several voices at once, its lanes are the voices. A bank that stores its states as arrays of lanes (structure of arrays) performs all its voices in the same loop so the compiler vectorizes across the voices. The voice lanes adapt a voice that can't be written this way, for example a static graph, the voices are then performed one after the other and only the active ones are performed.
+     The voice must define the constants ninputs, noutputs and nvectors and the methods prepare(samplerate, vectorsize, buffer), trigger(key, velocity), release(), isActive() and perform(size, inputs, outputs) like a static graph. The buffer of the lanes holds the output vectors of the voices followed by the nvectors vectors of each voice.
+     */
+    template <class Voice, ulong Lanes> class DspVoiceLanes
+    {
+    public:
+        static constexpr ulong lanes    = Lanes;
+        static constexpr ulong ninputs  = Voice::ninputs;
+        static constexpr ulong noutputs = Voice::noutputs;
+        static constexpr ulong nvectors = Voice::noutputs + Voice::nvectors * Lanes;
+
+        static_assert(Lanes > 0ul && Lanes <= sizeof(ulong) * 8ul, "The number of lanes must fit in a mask.");
+    private:
+        Voice           m_voices[Lanes];
+        sample*         m_outputs[noutputs + 1ul];
+    public:
+
+        //! Retrieve a voice.
+        /** The function retrieves the voice of a lane.
+         @param lane The lane.
+         @return The voice.
+         */
+        inline Voice& get(const ulong lane) noexcept
+        {
+            return m_voices[lane];
+        }
+
+        //! Prepare the voices.
+        /** The function shares the buffer between the outputs and the voices and prepares the voices.
+         @param samplerate The sample rate.
+         @param vectorsize The vector size.
+         @param buffer     The nvectors vectors of the bank.
+         */
+        void prepare(const ulong samplerate, const ulong vectorsize, sample* buffer) noexcept
+        {
+            for(ulong i = 0; i < noutputs; i++)
+            {
+                m_outputs[i] = buffer + i * vectorsize;
+            }
+            for(ulong i = 0; i < Lanes; i++)
+            {
+                m_voices[i].prepare(samplerate, vectorsize, buffer + (noutputs + i * Voice::nvectors) * vectorsize);
+            }
+        }
+
+        //! Start a voice.
+        /** The function starts the voice of a lane.
+         @param lane     The lane.
+         @param key      The key of the note.
+         @param velocity The velocity of the note.
+         */
+        inline void trigger(const ulong lane, const ulong key, const sample velocity) noexcept
+        {
+            m_voices[lane].trigger(key, velocity);
+        }
+
+        //! Release a voice.
+        /** The function releases the voice of a lane, the voice can still sound until its tail is over.
+         @param lane The lane.
+         */
+        inline void release(const ulong lane) noexcept
+        {
+            m_voices[lane].release();
+        }
+
+        //! Check if a voice is active.
+        /** The function checks if the voice of a lane still sounds.
+         @param lane The lane.
+         @return True if the voice is active, otherwise false.
+         */
+        inline bool isActive(const ulong lane) const noexcept
+        {
+            return m_voices[lane].isActive();
+        }
+
+        //! Perform the voices.
+        /** The function performs the voices of the mask and adds them to the outputs.
+         @param size    The number of samples.
+         @param mask    The lanes to perform.
+         @param inputs  The input vectors shared by the voices.
+         @param outputs The output vectors.
+         */
+        inline void perform(const ulong size, const ulong mask, const sample* const* inputs, sample* const* outputs) noexcept
+        {
+            for(ulong i = 0; i < Lanes; i++)
+            {
+                if(mask & (1ul << i))
+                {
+                    m_voices[i].perform(size, inputs, m_outputs);
+                    for(ulong j = 0; j < noutputs; j++)
+                    {
+                        Signal::vadd(size, m_outputs[j], outputs[j]);
+                    }
+                }
+            }
+        }
+    };
+
+    // ================================================================================ //
+    //                                      DSP VOICES                                  //
+    // ================================================================================ //
+
+    //! The dsp voices node plays several voices of the same template.
+    /**
+     The dsp voices node owns a fixed number of banks, each bank processes a group of voices in its lanes (see DspVoiceLanes). The chain sees one node whatever the number of voices. The notes are received as events, the index of the event is the key and the value is the velocity, a null velocity releases the key. A note takes a free voice, otherwise it steals the oldest released voice or the oldest voice. The voices that don't sound anymore sleep, the banks without active voices aren't performed.
+     The bank must define the constants lanes, ninputs, noutputs and nvectors and the methods prepare(samplerate, vectorsize, buffer), trigger(lane, key, velocity), release(lane), isActive(lane) and perform(size, mask, inputs, outputs) that adds the lanes of the mask to the outputs. The buffer holds the nvectors vectors that the bank needs during the perform method, the node allocates it from the memory of the chain. The banks add to the outputs while they read the inputs, so the node isn't inplace.
+     */
+    template <class Bank, ulong Nbanks> class DspVoices : public DspNode
+    {
+    public:
+        static constexpr ulong nvoices = Bank::lanes * Nbanks;
+        static constexpr ulong none    = ~0ul;
+
+        static_assert(Nbanks > 0ul, "The node must own at least one bank.");
+    private:
+        Bank    m_banks[Nbanks];
+        ulong   m_masks[Nbanks];
+        ulong   m_keys[nvoices];
+        ulong   m_ages[nvoices];
+        bool    m_released[nvoices];
+        ulong   m_age;
+        ulong   m_nsteals;
+
+        inline ulong find(const ulong key) const noexcept
+        {
+            for(ulong i = 0; i < nvoices; i++)
+            {
+                if(m_keys[i] == key && !m_released[i])
+                {
+                    return i;
+                }
+            }
+            return none;
+        }
+
+        inline ulong acquire() noexcept
+        {
+            ulong voice = none;
+            for(ulong i = 0; i < nvoices && voice == none; i++)
+            {
+                if(!(m_masks[i / Bank::lanes] & (1ul << (i % Bank::lanes))))
+                {
+                    voice = i;
+                }
+            }
+            if(voice == none)
+            {
+                // The oldest released voice is the least audible, otherwise the oldest note is stolen.
+                for(ulong i = 0; i < nvoices; i++)
+                {
+                    if(voice == none || m_released[i] > m_released[voice] || (m_released[i] == m_released[voice] && m_ages[i] < m_ages[voice]))
+                    {
+                        voice = i;
+                    }
+                }
+                m_nsteals++;
+            }
+            return voice;
+        }
+    public:
+
+        //! Constructor.
+        /** The function creates the inputs and the outputs of the banks and allows the node to receive the notes. The banks add their voices to the outputs so they can't share the vectors of the inputs.
+         @param chain    The dsp chain.
+         @param capacity The maximum number of pending notes.
+         */
+        DspVoices(sDspChain chain, const ulong capacity = 256ul) : DspNode(chain),
+        m_age(0ul),
+        m_nsteals(0ul)
+        {
+            setNumberOfInlets(Bank::ninputs);
+            setNumberOfOutlets(Bank::noutputs);
+            setEventsCapacity(capacity);
+            shouldSplitEvents(true);
+            setInplace(false);
+            for(ulong i = 0; i < Nbanks; i++)
+            {
+                m_masks[i] = 0ul;
+            }
+            for(ulong i = 0; i < nvoices; i++)
+            {
+                m_keys[i]       = none;
+                m_ages[i]       = 0ul;
+                m_released[i]   = false;
+            }
+        }
+
+        //! Retrieve a bank.
+        /** The function retrieves a bank to access its voices, the voice v is the lane v % lanes of the bank v / lanes.
+         @param index The index of the bank.
+         @return The bank.
+         */
+        inline Bank& getBank(const ulong index) noexcept
+        {
+            return m_banks[index];
+        }
+
+        //! Retrieve the number of active voices.
+        /** The function retrieves the number of voices that were active during the last block.
+         @return The number of active voices.
+         */
+        inline ulong getNumberOfActiveVoices() const noexcept
+        {
+            ulong count = 0ul;
+            for(ulong i = 0; i < Nbanks; i++)
+            {
+                for(ulong mask = m_masks[i]; mask; mask &= mask - 1ul)
+                {
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        //! Retrieve the number of stolen voices.
+        /** The function retrieves the number of notes that had to steal a voice.
+         @return The number of stolen voices.
+         */
+        inline ulong getNumberOfSteals() const noexcept
+        {
+            return m_nsteals;
+        }
+
+        //! Play a note.
+        /** The function pushes a note to the node, it can be called from any thread.
+         @param time     The time of the note in the sample time of the chain (see DspChain::getTime).
+         @param key      The key of the note.
+         @param velocity The velocity of the note, a null velocity releases the key.
+         @return true if the note has been pushed, otherwise false.
+         */
+        inline bool play(const ulong time, const ulong key, const sample velocity) noexcept
+        {
+            return pushEvent(time, key, velocity);
+        }
+
+        //! Receive a note.
+        /** The function starts or releases a voice.
+         @param event The note.
+         */
+        void receive(DspEvent const& event) noexcept override
+        {
+            ulong voice = find(event.index);
+            if(event.value == 0.)
+            {
+                if(voice != none)
+                {
+                    m_banks[voice / Bank::lanes].release(voice % Bank::lanes);
+                    m_released[voice] = true;
+                }
+                return;
+            }
+            if(voice == none)
+            {
+                voice = acquire();
+            }
+            m_banks[voice / Bank::lanes].trigger(voice % Bank::lanes, event.index, event.value);
+            m_masks[voice / Bank::lanes] |= (1ul << (voice % Bank::lanes));
+            m_keys[voice]       = event.index;
+            m_ages[voice]       = m_age++;
+            m_released[voice]   = false;
+        }
+
+        //! Prepare the node.
+        /** The function allocates the buffers of the banks from the memory of the chain and prepares the banks with the sample rate and the vector size of the node, all the voices sleep. The node doesn't perform if the buffers can't be allocated.
+         */
+        void prepare() noexcept override
+        {
+            for(ulong i = 0; i < Nbanks; i++)
+            {
+                sample* buffer = nullptr;
+                if(Bank::nvectors)
+                {
+                    buffer = allocate(Bank::nvectors * getVectorSize());
+                    if(!buffer)
+                    {
+                        shouldPerform(false);
+                        return;
+                    }
+                }
+                m_banks[i].prepare(getSampleRate(), getVectorSize(), buffer);
+                m_masks[i] = 0ul;
+            }
+            for(ulong i = 0; i < nvoices; i++)
+            {
+                m_keys[i]       = none;
+                m_released[i]   = false;
+            }
+            shouldPerform(true);
+        }
+
+        //! Perform the node.
+        /** The function performs the banks that have active voices, the voices that ended during the block go to sleep.
+         */
+        void perform() noexcept override
+        {
+            const ulong size = getVectorSize();
+            sample* const* outputs = getOutputsSamples();
+            for(ulong i = 0; i < Bank::noutputs; i++)
+            {
+                Signal::vclear(size, outputs[i]);
+            }
+            for(ulong i = 0; i < Nbanks; i++)
+            {
+                if(m_masks[i])
+                {
+                    m_banks[i].perform(size, m_masks[i], getInputsSamples(), outputs);
+                    for(ulong j = 0; j < Bank::lanes; j++)
+                    {
+                        if((m_masks[i] & (1ul << j)) && !m_banks[i].isActive(j))
+                        {
+                            m_masks[i] &= ~(1ul << j);
+                            m_keys[i * Bank::lanes + j] = none;
+                        }
+                    }
+                }
+            }
+        }
+    };
+}
+
+
+#endif
+
+
@@ -0,0 +1,101 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+#include "KiwiDspTest.h"
+
+using namespace Kiwi;
+
+int main()
+{
+    shared_ptr<DspTestDevice> device = make_shared<DspTestDevice>();
+    sDspContext context = make_shared<DspContext>(device);
+    sDspChain chain = make_shared<DspChain>(context);
+    context->add(chain);
+    
+    shared_ptr<DspTestSignal> signal = make_shared<DspTestSignal>(chain, 1.);
+    shared_ptr<DspTestSink> sink = make_shared<DspTestSink>(chain);
+    chain->add(signal);
+    chain->add(sink);
+    chain->add(make_shared<DspLink>(chain, signal, 0, sink, 0));
+    chain->start();
+    context->start();
+    device->run();
+    assert(sink->m_value == 1.);
+    
+    // The chains and the contexts are added and removed while the audio thread ticks them, the others keep running.
+    ulong nperforms = sink->m_nperforms;
+    atomic<ulong> ngaps(0ul);
+    {
+        DspTestThread audio(*device, [&]()
+        {
+            if(sink->m_nperforms == nperforms)
+            {
+                ngaps++;
+            }
+            nperforms = sink->m_nperforms;
+        });
+        for(ulong i = 0; i < 50ul; i++)
+        {
+            sDspContext other = make_shared<DspContext>(device);
+            sDspChain added = make_shared<DspChain>(i % 2ul ? other : context);
+            shared_ptr<DspTestSignal> source = make_shared<DspTestSignal>(added, sample(i));
+            shared_ptr<DspTestSink> reader = make_shared<DspTestSink>(added);
+            added->add(source);
+            added->add(reader);
+            added->add(make_shared<DspLink>(added, source, 0, reader, 0));
+            added->start();
+            if(i % 2ul)
+            {
+                other->add(added);
+                other->start();
+                assert(device->getNumberOfContext() == 2ul);
+            }
+            else
+            {
+                context->add(added);
+                assert(context->getNumberOfChains() == 2ul);
+            }
+            assert(audio.wait(2ul));
+            assert(reader->m_nperforms > 0ul && reader->m_value == sample(i));
+            
+            // Once the chain or the context is removed, the audio thread doesn't tick it anymore.
+            if(i % 2ul)
+            {
+                other->stop();
+                assert(device->getNumberOfContext() == 1ul);
+            }
+            else
+            {
+                context->remove(added);
+                assert(context->getNumberOfChains() == 1ul);
+            }
+            const ulong nreads = reader->m_nperforms;
+            assert(reader->m_released);
+            assert(audio.wait(2ul));
+            assert(reader->m_nperforms == nreads && reader->m_nerrors == 0ul);
+        }
+    }
+    assert(ngaps == 0ul && sink->m_nerrors == 0ul && sink->m_value == 1.);
+    chain->stop();
+    context->remove(chain);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+#include "KiwiDspTest.h"
+
+using namespace Kiwi;
+
+int main()
+{
+    shared_ptr<DspTestDevice> device = make_shared<DspTestDevice>();
+    sDspContext context = make_shared<DspContext>(device);
+    sDspChain chain = make_shared<DspChain>(context);
+    context->add(chain);
+    
+    shared_ptr<DspTestSignal> signal = make_shared<DspTestSignal>(chain, 1.);
+    shared_ptr<DspTestGain> gain = make_shared<DspTestGain>(chain, 2.);
+    shared_ptr<DspTestSink> sink = make_shared<DspTestSink>(chain);
+    chain->add(signal);
+    chain->add(gain);
+    chain->add(sink);
+    chain->add(make_shared<DspLink>(chain, signal, 0, gain, 0));
+    chain->add(make_shared<DspLink>(chain, gain, 0, sink, 0));
+    chain->start();
+    context->start();
+    device->run();
+    assert(sink->m_value == 2.);
+    
+    // An edit only restarts the nodes that it reaches, the other nodes keep their state.
+    const ulong nprepares = gain->m_nprepares;
+    shared_ptr<DspTestSignal> other = make_shared<DspTestSignal>(chain, 3.);
+    shared_ptr<DspTestGain> through = make_shared<DspTestGain>(chain, 1.);
+    chain->add(other);
+    chain->add(through);
+    chain->add(make_shared<DspLink>(chain, other, 0, through, 0));
+    sDspLink link = make_shared<DspLink>(chain, through, 0, sink, 0);
+    chain->add(link);
+    device->run();
+    assert(sink->m_value == 5.);
+    chain->remove(link);
+    device->run();
+    assert(sink->m_value == 2.);
+    assert(gain->m_nprepares == nprepares);
+    
+    // A link that closes a loop is refused and the chain keeps running.
+    bool loop = false;
+    chain->add(make_shared<DspLink>(chain, gain, 0, through, 0));
+    try
+    {
+        chain->add(make_shared<DspLink>(chain, through, 0, gain, 0));
+    }
+    catch(DspError& e)
+    {
+        loop = e.getType() == DspError::Loop;
+    }
+    assert(loop && chain->isRunning());
+    device->run();
+    assert(sink->m_value == 2.);
+    chain->remove(through);
+    chain->remove(other);
+    
+    // A removed node is withdrawn from the plan before it is released, the audio thread never performs it afterward.
+    {
+        DspTestThread audio(*device);
+        for(ulong i = 0; i < 50ul; i++)
+        {
+            shared_ptr<DspTestSink> reader = make_shared<DspTestSink>(chain);
+            chain->add(reader);
+            chain->add(make_shared<DspLink>(chain, gain, 0, reader, 0));
+            assert(audio.wait(2ul));
+            assert(reader->m_nperforms > 0ul && reader->m_value == 2.);
+            chain->remove(reader);
+            const ulong nperforms = reader->m_nperforms;
+            assert(reader->m_released);
+            assert(audio.wait(2ul));
+            assert(reader->m_nperforms == nperforms && reader->m_nerrors == 0ul);
+        }
+    }
+    assert(sink->m_nerrors == 0ul && sink->m_value == 2.);
+    chain->stop();
+    context->remove(chain);
+    return 0;
+}
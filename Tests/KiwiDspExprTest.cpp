@@ -0,0 +1,55 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+#include "KiwiDspTest.h"
+
+using namespace Kiwi;
+
+int main()
+{
+    // An equation with an unbound variable can't be compiled, the variable would be read as zero.
+    DspExpr unbound("gain", "y(t) = x(t) * g");
+    DspKernel kernel;
+    assert(!unbound.compile(kernel));
+    assert(!unbound.getKernel());
+    
+    DspExpr bound("gain", "y(t) = x(t) * g");
+    sample gain = 5.;
+    bound.addVariable('g', &gain);
+    shared_ptr<const DspKernel> compiled = bound.getKernel();
+    assert(compiled);
+    
+    sample input[4] = {1., 2., 3., 6.}, output[4];
+    const sample* inputs[1] = {input};
+    compiled->perform(4, inputs, output);
+    assert(output[0] == 5. && output[3] == 30.);
+    
+    // The simplification keeps the results of IEEE arithmetic, x * 0 isn't zero if x is infinite or not a number.
+    assert(!(DspTerm::input(0) * DspTerm::constant(0.)).simplify().isConstant());
+    assert(!(DspTerm::constant(0.) / DspTerm::input(0)).simplify().isConstant());
+    assert((DspTerm::input(0) / DspTerm::constant(3.)).simplify().toString() == "(x0 / 3)");
+    
+    // The constants are printed with enough digits to be parsed back.
+    const sample tenth = sample(0.1);
+    assert(DspTerm::parse(DspTerm::constant(tenth).toString()).getValue() == tenth);
+    return 0;
+}
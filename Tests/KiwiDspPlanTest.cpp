@@ -0,0 +1,99 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+#include "KiwiDspTest.h"
+
+using namespace Kiwi;
+
+int main()
+{
+    shared_ptr<DspTestDevice> device = make_shared<DspTestDevice>();
+    sDspContext context = make_shared<DspContext>(device);
+    sDspChain chain = make_shared<DspChain>(context);
+    context->add(chain);
+    
+    shared_ptr<DspTestSignal> signal = make_shared<DspTestSignal>(chain, 1.);
+    shared_ptr<DspTestGain> gain = make_shared<DspTestGain>(chain, 2.);
+    shared_ptr<DspTestSink> sink = make_shared<DspTestSink>(chain);
+    chain->add(signal);
+    chain->add(gain);
+    chain->add(sink);
+    chain->add(make_shared<DspLink>(chain, signal, 0, gain, 0));
+    chain->add(make_shared<DspLink>(chain, gain, 0, sink, 0));
+    chain->start();
+    context->start();
+    device->run();
+    assert(sink->m_value == 2.);
+    
+    // A full recompilation while the audio thread runs replaces the plan between two ticks, no tick skips the chain or reads a vector that isn't ready.
+    ulong nperforms = sink->m_nperforms;
+    atomic<ulong> ngaps(0ul), nerrors(0ul);
+    {
+        DspTestThread audio(*device, [&]()
+        {
+            if(sink->m_nperforms == nperforms)
+            {
+                ngaps++;
+            }
+            if(sink->m_value != 2.)
+            {
+                nerrors++;
+            }
+            nperforms = sink->m_nperforms;
+        });
+        assert(audio.wait(10ul));
+        for(ulong i = 0; i < 40ul; i++)
+        {
+            chain->start();
+            if(i % 8ul == 0ul)
+            {
+                shared_ptr<DspTestSink> reader = make_shared<DspTestSink>(chain);
+                chain->begin();
+                chain->add(reader);
+                chain->add(make_shared<DspLink>(chain, gain, 0, reader, 0));
+                chain->commit();
+                chain->begin();
+                chain->remove(reader);
+                chain->commit();
+                chain->setBlockSize(i % 16ul ? 32ul : 0ul);
+            }
+        }
+        assert(audio.wait(2ul));
+    }
+    assert(ngaps == 0ul && nerrors == 0ul && sink->m_nerrors == 0ul);
+    
+    // The nodes are prepared with the new vector size once the plan is installed.
+    const ulong nprepares = gain->m_nprepares;
+    chain->setBlockSize(16ul);
+    assert(chain->getVectorSize() == 16ul && gain->getVectorSize() == 16ul);
+    assert(gain->m_nprepares == nprepares + 1ul);
+    device->run();
+    assert(sink->m_value == 2.);
+    
+    // A chain that is stopped releases its nodes, the audio thread doesn't perform them anymore.
+    chain->stop();
+    nperforms = sink->m_nperforms;
+    device->run();
+    assert(sink->m_nperforms == nperforms && sink->m_released);
+    context->remove(chain);
+    return 0;
+}
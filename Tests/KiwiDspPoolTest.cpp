@@ -0,0 +1,133 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+#include "KiwiDspTest.h"
+
+using namespace Kiwi;
+
+int main()
+{
+    // Each task pushed in the queue is taken once, either popped by the owner or stolen by another thread.
+    {
+        const ulong ntasks = 256ul, npasses = 400ul;
+        DspTaskQueue queue(2ul * ntasks);
+        unique_ptr<atomic<ulong>[]> ntakes(new atomic<ulong>[ntasks * npasses]);
+        for(ulong i = 0; i < ntasks * npasses; i++)
+        {
+            ntakes[i] = 0ul;
+        }
+        atomic<bool> done(false);
+        vector<thread> thieves;
+        for(ulong i = 0; i < 3ul; i++)
+        {
+            thieves.push_back(thread([&]()
+            {
+                while(!done)
+                {
+                    const ulong task = queue.steal();
+                    if(task != DspTaskQueue::empty)
+                    {
+                        ntakes[task]++;
+                    }
+                }
+            }));
+        }
+        for(ulong i = 0; i < npasses; i++)
+        {
+            for(ulong j = 0; j < ntasks; j++)
+            {
+                queue.push(i * ntasks + j);
+            }
+            for(ulong task = queue.pop(); task != DspTaskQueue::empty; task = queue.pop())
+            {
+                ntakes[task]++;
+            }
+        }
+        done = true;
+        for(auto& thief : thieves)
+        {
+            thief.join();
+        }
+        for(ulong i = 0; i < ntasks * npasses; i++)
+        {
+            assert(ntakes[i] == 1ul);
+        }
+    }
+    
+    shared_ptr<DspTestDevice> device = make_shared<DspTestDevice>();
+    sDspContext context = make_shared<DspContext>(device);
+    sDspChain chain = make_shared<DspChain>(context);
+    context->add(chain);
+    
+    // The independent branches performed by the workers give the same result as the serial chain.
+    shared_ptr<DspTestSignal> signal = make_shared<DspTestSignal>(chain, 1.);
+    shared_ptr<DspTestSink> sink = make_shared<DspTestSink>(chain);
+    chain->add(signal);
+    chain->add(sink);
+    for(ulong i = 0; i < 64ul; i++)
+    {
+        shared_ptr<DspTestGain> first = make_shared<DspTestGain>(chain, sample(i + 1ul));
+        shared_ptr<DspTestGain> second = make_shared<DspTestGain>(chain, 2.);
+        chain->add(first);
+        chain->add(second);
+        chain->add(make_shared<DspLink>(chain, signal, 0, first, 0));
+        chain->add(make_shared<DspLink>(chain, first, 0, second, 0));
+        chain->add(make_shared<DspLink>(chain, second, 0, sink, 0));
+    }
+    chain->setNumberOfThreads(3ul, vector<ulong>(1ul, 0ul));
+    chain->start();
+    context->start();
+    assert(chain->getNumberOfThreads() == 3ul);
+    for(ulong i = 0; i < 200ul; i++)
+    {
+        device->run();
+        assert(sink->m_value == 4160.);
+    }
+    
+    // The number of threads changes while the audio thread runs, the plans keep their pool until they are replaced.
+    ulong nperforms = sink->m_nperforms;
+    atomic<ulong> ngaps(0ul), nerrors(0ul);
+    {
+        DspTestThread audio(*device, [&]()
+        {
+            if(sink->m_nperforms == nperforms)
+            {
+                ngaps++;
+            }
+            if(sink->m_value != 4160.)
+            {
+                nerrors++;
+            }
+            nperforms = sink->m_nperforms;
+        });
+        for(ulong i = 0; i < 20ul; i++)
+        {
+            chain->setNumberOfThreads(i % 4ul);
+            assert(chain->getNumberOfThreads() == i % 4ul);
+            assert(audio.wait(2ul));
+        }
+    }
+    assert(ngaps == 0ul && nerrors == 0ul && sink->m_nerrors == 0ul);
+    chain->stop();
+    context->remove(chain);
+    return 0;
+}
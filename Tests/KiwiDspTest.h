@@ -0,0 +1,265 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+
+#ifndef __DEF_KIWI_DSP_TEST__
+#define __DEF_KIWI_DSP_TEST__
+
+#include "../KiwiDsp.h"
+
+// The tests keep their assertions in the release builds.
+#undef NDEBUG
+#include <cassert>
+#include <thread>
+#include <chrono>
+
+namespace Kiwi
+{
+    // ================================================================================ //
+    //                                      DSP TEST DEVICE                             //
+    // ================================================================================ //
+
+    //! The dsp test device is a device manager without driver.
+    /**
+     The dsp test device has no input and two outputs, the tests tick it from the thread of their choice to stand for the audio thread. Each test is a standalone program built with the sources of the library, it returns zero if all its assertions hold.
+     */
+    class DspTestDevice : public DspDeviceManager
+    {
+    private:
+        ulong           m_vectorsize;
+        vector<sample>  m_outputs;
+    public:
+
+        //! Constructor.
+        /** The function allocates the outputs.
+         @param vectorsize The vector size of the device.
+         */
+        DspTestDevice(const ulong vectorsize = 64ul) : m_vectorsize(vectorsize), m_outputs(2ul * 4096ul, 0.)
+        {
+            ;
+        }
+
+        void getAvailableDrivers(vector<string>&) const override {}
+        string getDriverName() const override {return string();}
+        void getAvailableInputDevices(vector<string>&) const override {}
+        void getAvailableOutputDevices(vector<string>&) const override {}
+        string getInputDeviceName() const override {return string();}
+        string getOutputDeviceName() const override {return string();}
+        ulong getNumberOfInputs() const override {return 0ul;}
+        ulong getNumberOfOutputs() const override {return 2ul;}
+        void getAvailableSampleRates(vector<ulong>&) const override {}
+        ulong getVectorSize() const override {return m_vectorsize;}
+        void getAvailableVectorSizes(vector<ulong>&) const override {}
+        ulong getSampleRate() const override {return 44100ul;}
+        void setDriver(string const&) override {}
+        void setInputDevice(string const&) override {}
+        void setOutputDevice(string const&) override {}
+        void setSampleRate(ulong const) override {}
+        void setVectorSize(ulong const vectorsize) override {m_vectorsize = vectorsize;}
+        void start() override {}
+        void stop() override {}
+        sample const* getInputsSamples(const ulong) const noexcept override {return nullptr;}
+        sample* getOutputsSamples(const ulong channel) const noexcept override {return const_cast<sample*>(m_outputs.data()) + channel * 4096ul;}
+
+        //! Tick the contexts.
+        /** The function performs one vector of the contexts.
+         */
+        inline void run() noexcept
+        {
+            tick();
+        }
+    };
+
+    // ================================================================================ //
+    //                                      DSP TEST THREAD                             //
+    // ================================================================================ //
+
+    //! The dsp test thread ticks a device like an audio thread.
+    /**
+     The dsp test thread ticks the device every 50 microseconds from its construction to its destruction, so the control thread of the test can edit the chains while they run. A function can be called after each tick on the thread to check the state of the nodes between two ticks.
+     */
+    class DspTestThread
+    {
+    private:
+        DspTestDevice&          m_device;
+        const function<void()>  m_check;
+        atomic<bool>            m_done;
+        atomic<ulong>           m_nticks;
+        thread                  m_thread;
+    public:
+
+        //! Constructor.
+        /** The function starts ticking the device.
+         @param device The device to tick.
+         @param check  The function called after each tick or nullptr.
+         */
+        DspTestThread(DspTestDevice& device, function<void()> check = nullptr) : m_device(device), m_check(check), m_done(false), m_nticks(0ul), m_thread([this]()
+        {
+            while(!m_done)
+            {
+                m_device.run();
+                if(m_check)
+                {
+                    m_check();
+                }
+                m_nticks++;
+                this_thread::sleep_for(chrono::microseconds(50));
+            }
+        })
+        {
+            ;
+        }
+
+        //! Destructor.
+        /** The function stops ticking the device.
+         */
+        ~DspTestThread()
+        {
+            m_done = true;
+            m_thread.join();
+        }
+
+        //! Wait for some ticks.
+        /** The function waits until the device has been ticked a number of times or until two seconds have elapsed.
+         @param nticks The number of ticks.
+         @return true if the device has been ticked the number of times, otherwise false.
+         */
+        bool wait(const ulong nticks) const noexcept
+        {
+            const ulong target = m_nticks + nticks;
+            const auto end = chrono::steady_clock::now() + chrono::seconds(2);
+            while(m_nticks < target && chrono::steady_clock::now() < end)
+            {
+                this_thread::yield();
+            }
+            return m_nticks >= target;
+        }
+    };
+
+    // ================================================================================ //
+    //                                      DSP TEST NODES                              //
+    // ================================================================================ //
+
+    //! The dsp test signal outputs a constant value.
+    class DspTestSignal : public DspNode
+    {
+    public:
+        atomic<sample> m_value;
+
+        DspTestSignal(sDspChain chain, const sample value) : DspNode(chain), m_value(value)
+        {
+            setNumberOfInlets(0ul);
+            setNumberOfOutlets(1ul);
+        }
+
+        void prepare() noexcept override
+        {
+            shouldPerform(true);
+        }
+
+        void perform() noexcept override
+        {
+            Signal::vfill(getVectorSize(), m_value.load(), getOutputsSamples()[0]);
+        }
+    };
+
+    //! The dsp test gain multiplies its input and counts its preparations.
+    class DspTestGain : public DspNode
+    {
+    public:
+        const sample    m_gain;
+        atomic<ulong>   m_nprepares;
+
+        DspTestGain(sDspChain chain, const sample gain) : DspNode(chain), m_gain(gain), m_nprepares(0ul)
+        {
+            setNumberOfInlets(1ul);
+            setNumberOfOutlets(1ul);
+        }
+
+        void prepare() noexcept override
+        {
+            m_nprepares++;
+            shouldPerform(true);
+        }
+
+        void perform() noexcept override
+        {
+            const sample* input = getInputsSamples()[0];
+            sample* output = getOutputsSamples()[0];
+            for(ulong i = 0; i < getVectorSize(); i++)
+            {
+                output[i] = input[i] * m_gain;
+            }
+        }
+    };
+
+    //! The dsp test sink records its input and the vectors it shouldn't have received.
+    /**
+     The sink expects a constant input, a vector that isn't constant or that is performed after the release of the node is counted as an error.
+     */
+    class DspTestSink : public DspNode
+    {
+    public:
+        atomic<sample>  m_value;
+        atomic<ulong>   m_nperforms;
+        atomic<ulong>   m_nerrors;
+        atomic<bool>    m_released;
+
+        DspTestSink(sDspChain chain) : DspNode(chain), m_value(0.), m_nperforms(0ul), m_nerrors(0ul), m_released(false)
+        {
+            setNumberOfInlets(1ul);
+            setNumberOfOutlets(0ul);
+        }
+
+        void prepare() noexcept override
+        {
+            m_released = false;
+            shouldPerform(true);
+        }
+
+        void perform() noexcept override
+        {
+            const sample* input = getInputsSamples()[0];
+            for(ulong i = 1; i < getVectorSize(); i++)
+            {
+                if(input[i] != input[0])
+                {
+                    m_nerrors++;
+                    break;
+                }
+            }
+            if(m_released)
+            {
+                m_nerrors++;
+            }
+            m_value = input[0];
+            m_nperforms++;
+        }
+
+        void release() noexcept override
+        {
+            m_released = true;
+        }
+    };
+}
+
+#endif
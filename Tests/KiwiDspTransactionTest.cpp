@@ -0,0 +1,114 @@
+/*
+ ==============================================================================
+ 
+ This file is part of the KIWI library.
+ Copyright (c) 2014 Pierre Guillot & Eliott Paris.
+ 
+ Permission is granted to use this software under the terms of either:
+ a) the GPL v2 (or any later version)
+ b) the Affero GPL v3
+ 
+ Details of these licenses can be found at: www.gnu.org/licenses
+ 
+ KIWI is distributed in the hope that it will be useful, but WITHOUT ANY
+ WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ 
+ ------------------------------------------------------------------------------
+ 
+ To release a closed-source product which uses KIWI, contact : guillotpierre6@gmail.com
+ 
+ ==============================================================================
+*/
+#include "KiwiDspTest.h"
+
+using namespace Kiwi;
+
+int main()
+{
+    shared_ptr<DspTestDevice> device = make_shared<DspTestDevice>();
+    sDspContext context = make_shared<DspContext>(device);
+    sDspChain chain = make_shared<DspChain>(context);
+    context->add(chain);
+    
+    shared_ptr<DspTestSignal> signal = make_shared<DspTestSignal>(chain, 1.);
+    shared_ptr<DspTestGain> gain = make_shared<DspTestGain>(chain, 2.);
+    shared_ptr<DspTestSink> sink = make_shared<DspTestSink>(chain);
+    chain->add(signal);
+    chain->add(gain);
+    chain->add(sink);
+    chain->add(make_shared<DspLink>(chain, signal, 0, gain, 0));
+    chain->add(make_shared<DspLink>(chain, gain, 0, sink, 0));
+    chain->start();
+    context->start();
+    device->run();
+    assert(sink->m_value == 2.);
+    
+    // The current plan keeps running during a transaction, the edits are only applied by the outermost commit.
+    vector<shared_ptr<DspTestGain>> gains;
+    chain->begin();
+    chain->begin();
+    for(ulong i = 0; i < 100ul; i++)
+    {
+        gains.push_back(make_shared<DspTestGain>(chain, 1.));
+        chain->add(gains.back());
+        chain->add(make_shared<DspLink>(chain, i ? gains[i-1] : gain, 0, gains.back(), 0));
+    }
+    chain->add(make_shared<DspLink>(chain, gains.back(), 0, sink, 0));
+    chain->commit();
+    device->run();
+    assert(chain->isRunning() && sink->m_value == 2. && !gains.back()->isRunning());
+    chain->commit();
+    device->run();
+    assert(gains.back()->isRunning() && sink->m_value == 4.);
+    
+    // The removals are applied by the commit, a removed node isn't performed afterward.
+    chain->begin();
+    for(auto& node : gains)
+    {
+        chain->remove(node);
+    }
+    device->run();
+    assert(sink->m_value == 4.);
+    chain->commit();
+    device->run();
+    assert(sink->m_value == 2. && chain->getNumberOfNodes() == 3ul);
+    
+    // The block size and the number of threads set inside a transaction recompile the chain once at the commit.
+    {
+        DspTestThread audio(*device);
+        for(ulong i = 0; i < 10ul; i++)
+        {
+            const ulong nprepares = gain->m_nprepares;
+            chain->begin();
+            chain->setBlockSize(i % 2ul ? 32ul : 0ul);
+            chain->setNumberOfThreads(i % 3ul);
+            chain->setBlockSize(i % 2ul ? 0ul : 32ul);
+            assert(gain->m_nprepares == nprepares);
+            chain->commit();
+            assert(gain->m_nprepares == nprepares + 1ul);
+            assert(chain->getNumberOfThreads() == i % 3ul && chain->getVectorSize() == (i % 2ul ? 64ul : 32ul));
+            assert(audio.wait(2ul));
+        }
+    }
+    assert(sink->m_nerrors == 0ul && sink->m_value == 2.);
+    
+    // A loop created inside a transaction is reported by the commit and the chain stays stopped.
+    bool loop = false;
+    shared_ptr<DspTestGain> back = make_shared<DspTestGain>(chain, 1.);
+    chain->begin();
+    chain->add(back);
+    chain->add(make_shared<DspLink>(chain, gain, 0, back, 0));
+    chain->add(make_shared<DspLink>(chain, back, 0, gain, 0));
+    try
+    {
+        chain->commit();
+    }
+    catch(DspError& e)
+    {
+        loop = e.getType() == DspError::Loop;
+    }
+    assert(loop && !chain->isRunning());
+    context->remove(chain);
+    return 0;
+}